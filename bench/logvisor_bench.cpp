@@ -0,0 +1,226 @@
+/* logvisor_bench: measures Module::report cost across the built-in loggers.
+ *
+ * Results are written as one JSON object per line so runs can be compared over
+ * time. Console output goes to the null device; file output goes to a scratch
+ * directory that is cleaned up afterwards. Build with CMAKE_BUILD_TYPE=Release
+ * for meaningful numbers. */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "logvisor/logvisor.hpp"
+
+namespace {
+
+logvisor::Module Log("bench");
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  size_t records = 200000;
+  size_t latencyRecords = 100000;
+  unsigned maxThreads = std::max(2u, std::thread::hardware_concurrency());
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "logvisor_bench";
+  FILE* out = stdout;
+};
+
+struct Sink {
+  const char* name;
+  std::function<void(const std::filesystem::path&)> install;
+  bool async;
+};
+
+#if _WIN32
+constexpr const char* NullDevice = "NUL";
+#else
+constexpr const char* NullDevice = "/dev/null";
+#endif
+
+void Install(const Sink& sink, const Options& opts) {
+  logvisor::DisableAsyncLogging();
+  logvisor::UnregisterLoggers();
+  std::filesystem::remove_all(opts.dir);
+  std::filesystem::create_directories(opts.dir);
+  sink.install(opts.dir);
+  if (sink.async)
+    logvisor::EnableAsyncLogging(4096, logvisor::AsyncOverflow::Block);
+}
+
+void Uninstall() {
+  logvisor::DisableAsyncLogging();
+  logvisor::UnregisterLoggers();
+}
+
+/* Representative mix of an integer, a float and a string per record */
+inline void ReportOne(size_t i) { Log.report(logvisor::Info, "record %zu value %.3f tag %s", i, i * 0.5, "bench"); }
+
+void Throughput(const Sink& sink, const Options& opts) {
+  Install(sink, opts);
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < opts.records; ++i)
+    ReportOne(i);
+  logvisor::FlushLog();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  Uninstall();
+  fprintf(opts.out,
+          "{\"case\":\"throughput\",\"sink\":\"%s\",\"threads\":1,\"records\":%zu,\"seconds\":%.6f,"
+          "\"records_per_sec\":%.0f,\"ns_per_record\":%.1f}\n",
+          sink.name, opts.records, seconds, opts.records / seconds, seconds * 1e9 / opts.records);
+}
+
+void Latency(const Sink& sink, const Options& opts) {
+  Install(sink, opts);
+  std::vector<uint32_t> samples(opts.latencyRecords);
+  for (size_t i = 0; i < opts.latencyRecords; ++i) {
+    Clock::time_point start = Clock::now();
+    ReportOne(i);
+    samples[i] = uint32_t(std::min<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(), UINT32_MAX));
+  }
+  logvisor::FlushLog();
+  Uninstall();
+  std::sort(samples.begin(), samples.end());
+  auto pct = [&](double p) { return samples[std::min(samples.size() - 1, size_t(p * samples.size()))]; };
+  fprintf(opts.out,
+          "{\"case\":\"latency\",\"sink\":\"%s\",\"records\":%zu,\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,"
+          "\"max_ns\":%u}\n",
+          sink.name, opts.latencyRecords, pct(0.5), pct(0.99), pct(0.999), samples.back());
+}
+
+void Scaling(const Sink& sink, const Options& opts) {
+  for (unsigned threads = 1; threads <= opts.maxThreads; threads *= 2) {
+    Install(sink, opts);
+    size_t perThread = opts.records / threads;
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    for (unsigned t = 0; t < threads; ++t)
+      workers.emplace_back([perThread]() {
+        for (size_t i = 0; i < perThread; ++i)
+          ReportOne(i);
+      });
+    for (std::thread& worker : workers)
+      worker.join();
+    logvisor::FlushLog();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    Uninstall();
+    size_t total = perThread * threads;
+    fprintf(opts.out,
+            "{\"case\":\"scaling\",\"sink\":\"%s\",\"threads\":%u,\"records\":%zu,\"seconds\":%.6f,"
+            "\"records_per_sec\":%.0f}\n",
+            sink.name, threads, total, seconds, total / seconds);
+  }
+}
+
+/* Message rendering alone: brace formatting versus vsnprintf for the same arguments */
+void Formatting(const Options& opts) {
+  char buf[256];
+  volatile size_t sink = 0;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < opts.records; ++i)
+    sink = sink + snprintf(buf, sizeof(buf), "record %zu value %.3f tag %s id %x", i, i * 0.5, "bench", unsigned(i));
+  double printfSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  logvisor::detail::FormatBuffer fbuf;
+  start = Clock::now();
+  for (size_t i = 0; i < opts.records; ++i) {
+    fbuf.clear();
+    logvisor::FormatTo(fbuf, "record {} value {:.3f} tag {} id {:x}", i, i * 0.5, "bench", unsigned(i));
+    sink = sink + fbuf.size();
+  }
+  double formatSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  fprintf(opts.out, "{\"case\":\"format\",\"impl\":\"snprintf\",\"records\":%zu,\"ns_per_record\":%.1f}\n",
+          opts.records, printfSeconds * 1e9 / opts.records);
+  fprintf(opts.out, "{\"case\":\"format\",\"impl\":\"logvisor\",\"records\":%zu,\"ns_per_record\":%.1f}\n",
+          opts.records, formatSeconds * 1e9 / opts.records);
+}
+
+void Usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--records N] [--latency-records N] [--threads N] [--dir PATH] [--out FILE]\n"
+          "Writes one JSON result per line to stdout or FILE.\n",
+          argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  const char* outPath = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--records") && hasValue)
+      opts.records = strtoull(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--latency-records") && hasValue)
+      opts.latencyRecords = strtoull(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--threads") && hasValue)
+      opts.maxThreads = unsigned(strtoul(argv[++i], nullptr, 10));
+    else if (!strcmp(argv[i], "--dir") && hasValue)
+      opts.dir = argv[++i];
+    else if (!strcmp(argv[i], "--out") && hasValue)
+      outPath = argv[++i];
+    else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!opts.records || !opts.latencyRecords || !opts.maxThreads) {
+    Usage(argv[0]);
+    return 1;
+  }
+  if (outPath && !(opts.out = fopen(outPath, "w"))) {
+    fprintf(stderr, "unable to open %s\n", outPath);
+    return 1;
+  }
+
+  /* ConsoleLogger writes to stderr; keep it off the terminal */
+  if (!freopen(NullDevice, "w", stderr))
+    return 1;
+
+  const Sink sinks[] = {
+      {"none", [](const std::filesystem::path&) {}, false},
+      {"console", [](const std::filesystem::path&) { logvisor::RegisterConsoleLogger(); }, false},
+      {"file", [](const std::filesystem::path& dir) { logvisor::RegisterFileLogger((dir / "bench.log").string().c_str()); },
+       false},
+      {"binary",
+       [](const std::filesystem::path& dir) { logvisor::RegisterBinaryLogger((dir / "bench.bin").string().c_str()); },
+       false},
+      {"file_async",
+       [](const std::filesystem::path& dir) { logvisor::RegisterFileLogger((dir / "bench.log").string().c_str()); },
+       true},
+      {"mapped",
+       [](const std::filesystem::path& dir) { logvisor::RegisterMappedLogger((dir / "bench").string().c_str()); },
+       false},
+      {"json",
+       [](const std::filesystem::path& dir) { logvisor::RegisterJsonLogger((dir / "bench.json").string().c_str()); },
+       false},
+      {"file_lz4",
+       [](const std::filesystem::path& dir) {
+         logvisor::FileLoggerOptions options;
+         options.compression = logvisor::FileCompression::LZ4;
+         logvisor::RegisterFileLogger((dir / "bench.log.lz4").string().c_str(), options);
+       },
+       false},
+  };
+
+  for (const Sink& sink : sinks)
+    Throughput(sink, opts);
+  for (const Sink& sink : sinks)
+    Latency(sink, opts);
+  Scaling(sinks[2], opts);
+  Scaling(sinks[4], opts);
+  Formatting(opts);
+
+  std::filesystem::remove_all(opts.dir);
+  if (opts.out != stdout)
+    fclose(opts.out);
+  return 0;
+}
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace logvisor {
+
+/* Type-safe brace formatting used by Module::format.
+ *
+ * Replacement fields are "{}" or "{:spec}" with spec following
+ * [[fill]align][sign][#][0][width][.precision][type], where align is one of
+ * '<' '>' '^', sign one of '+' '-' ' ', and type one of:
+ *   integers:       d x X o b c
+ *   floating point: f F e E g G a A
+ *   strings:        s
+ *   pointers:       p
+ * "{{" and "}}" produce literal braces. Fields are consumed in order; positional
+ * indices are not supported. The format string is parsed and validated against the
+ * argument types at compile time, so the runtime cost is only writing the output. */
+
+namespace detail {
+
+enum class ArgKind : uint8_t { Bool, Char, Signed, Unsigned, Float, String, Pointer };
+
+template <typename T>
+constexpr ArgKind KindOf() {
+  using U = std::remove_cv_t<std::remove_reference_t<T>>;
+  if constexpr (std::is_same_v<U, bool>)
+    return ArgKind::Bool;
+  else if constexpr (std::is_same_v<U, char>)
+    return ArgKind::Char;
+  else if constexpr (std::is_enum_v<U>)
+    return std::is_signed_v<std::underlying_type_t<U>> ? ArgKind::Signed : ArgKind::Unsigned;
+  else if constexpr (std::is_integral_v<U>)
+    return std::is_signed_v<U> ? ArgKind::Signed : ArgKind::Unsigned;
+  else if constexpr (std::is_floating_point_v<U>)
+    return ArgKind::Float;
+  else if constexpr (std::is_null_pointer_v<U>) /* Also convertible to string_view */
+    return ArgKind::Pointer;
+  else if constexpr (std::is_convertible_v<U, std::string_view>)
+    return ArgKind::String;
+  else if constexpr (std::is_pointer_v<U>)
+    return ArgKind::Pointer;
+  else
+    static_assert(std::is_void_v<U> && !std::is_void_v<U>, "logvisor::Module::format argument type not supported");
+}
+
+struct FieldSpec {
+  char fill = ' ';
+  char align = 0;
+  char sign = '-';
+  char type = 0;
+  bool alt = false;
+  bool zero = false;
+  int width = 0;
+  int precision = -1;
+};
+
+struct Field {
+  size_t litBegin = 0; /**< Literal text preceding this field */
+  size_t litEnd = 0;
+  FieldSpec spec;
+};
+
+/* Not constexpr: reaching one of these during constant evaluation fails compilation with the message */
+void FormatErrorUnbalancedBrace();
+void FormatErrorTooFewArguments();
+void FormatErrorTooManyArguments();
+void FormatErrorBadSpec();
+void FormatErrorTypeMismatch();
+
+constexpr bool TypeAccepts(ArgKind kind, char type) {
+  switch (type) {
+  case 0:
+    return true;
+  case 'd':
+  case 'x':
+  case 'X':
+  case 'o':
+  case 'b':
+  case 'c':
+    return kind == ArgKind::Signed || kind == ArgKind::Unsigned || kind == ArgKind::Char || kind == ArgKind::Bool;
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    return kind == ArgKind::Float;
+  case 's':
+    return kind == ArgKind::String || kind == ArgKind::Bool || kind == ArgKind::Char;
+  case 'p':
+    return kind == ArgKind::Pointer;
+  default:
+    return false;
+  }
+}
+
+constexpr size_t ParseSpec(const char* str, size_t pos, size_t len, FieldSpec& spec) {
+  auto isAlign = [](char c) { return c == '<' || c == '>' || c == '^'; };
+  if (pos + 1 < len && isAlign(str[pos + 1]) && str[pos] != '}') {
+    spec.fill = str[pos];
+    spec.align = str[pos + 1];
+    pos += 2;
+  } else if (pos < len && isAlign(str[pos])) {
+    spec.align = str[pos++];
+  }
+  if (pos < len && (str[pos] == '+' || str[pos] == '-' || str[pos] == ' '))
+    spec.sign = str[pos++];
+  if (pos < len && str[pos] == '#') {
+    spec.alt = true;
+    ++pos;
+  }
+  if (pos < len && str[pos] == '0') {
+    spec.zero = true;
+    ++pos;
+  }
+  while (pos < len && str[pos] >= '0' && str[pos] <= '9')
+    spec.width = spec.width * 10 + (str[pos++] - '0');
+  if (pos < len && str[pos] == '.') {
+    ++pos;
+    if (pos >= len || str[pos] < '0' || str[pos] > '9')
+      FormatErrorBadSpec();
+    spec.precision = 0;
+    while (pos < len && str[pos] >= '0' && str[pos] <= '9')
+      spec.precision = spec.precision * 10 + (str[pos++] - '0');
+  }
+  if (pos < len && str[pos] != '}')
+    spec.type = str[pos++];
+  if (pos >= len || str[pos] != '}')
+    FormatErrorBadSpec();
+  return pos + 1;
+}
+
+/* Growable output buffer reused across reports on the same thread */
+class FormatBuffer {
+  std::unique_ptr<char[]> m_data;
+  size_t m_size = 0;
+  size_t m_cap = 0;
+
+  void grow(size_t need) {
+    size_t cap = m_cap ? m_cap : 512;
+    while (cap < need)
+      cap *= 2;
+    std::unique_ptr<char[]> data(new char[cap]);
+    if (m_size)
+      memcpy(data.get(), m_data.get(), m_size);
+    m_data = std::move(data);
+    m_cap = cap;
+  }
+
+public:
+  void clear() { m_size = 0; }
+  size_t size() const { return m_size; }
+  char* data() { return m_data.get(); }
+  /* Returns space for count more characters; commit() the number used */
+  char* reserve(size_t count) {
+    if (m_size + count > m_cap)
+      grow(m_size + count);
+    return m_data.get() + m_size;
+  }
+  void commit(size_t count) { m_size += count; }
+  void append(const char* str, size_t len) {
+    memcpy(reserve(len), str, len);
+    m_size += len;
+  }
+  void append(char c, size_t count) {
+    memset(reserve(count), c, count);
+    m_size += count;
+  }
+  /* Null-terminates without counting the terminator */
+  const char* c_str() {
+    *reserve(1) = '\0';
+    return m_data.get();
+  }
+};
+
+/* Lends out the calling thread's buffer, or a private one if a nested report already holds it */
+class ScopedFormatBuffer {
+  struct ThreadSlot {
+    FormatBuffer buffer;
+    bool busy = false;
+  };
+  static ThreadSlot& slot() {
+    static thread_local ThreadSlot s;
+    return s;
+  }
+  std::unique_ptr<FormatBuffer> m_private;
+  FormatBuffer* m_buffer;
+
+public:
+  ScopedFormatBuffer() {
+    ThreadSlot& s = slot();
+    if (s.busy) {
+      m_private.reset(new FormatBuffer);
+      m_buffer = m_private.get();
+    } else {
+      s.busy = true;
+      m_buffer = &s.buffer;
+      m_buffer->clear();
+    }
+  }
+  ~ScopedFormatBuffer() {
+    if (!m_private)
+      slot().busy = false;
+  }
+  FormatBuffer& operator*() { return *m_buffer; }
+  FormatBuffer* operator->() { return m_buffer; }
+};
+
+inline void WritePadded(FormatBuffer& out, const FieldSpec& spec, const char* str, size_t len, char defaultAlign) {
+  if (spec.width <= 0 || size_t(spec.width) <= len) {
+    out.append(str, len);
+    return;
+  }
+  size_t pad = size_t(spec.width) - len;
+  char align = spec.align ? spec.align : defaultAlign;
+  size_t before = align == '>' ? pad : align == '^' ? pad / 2 : 0;
+  out.append(spec.fill, before);
+  out.append(str, len);
+  out.append(spec.fill, pad - before);
+}
+
+/* Writes prefix (sign and radix marker) and digits, honoring zero padding between them */
+inline void WriteNumber(FormatBuffer& out, const FieldSpec& spec, const char* prefix, size_t prefixLen,
+                        const char* digits, size_t digitsLen) {
+  size_t len = prefixLen + digitsLen;
+  size_t pad = spec.width > 0 && size_t(spec.width) > len ? size_t(spec.width) - len : 0;
+  if (spec.zero && !spec.align) {
+    out.append(prefix, prefixLen);
+    out.append('0', pad);
+    out.append(digits, digitsLen);
+    return;
+  }
+  char align = spec.align ? spec.align : '>';
+  size_t before = align == '>' ? pad : align == '^' ? pad / 2 : 0;
+  out.append(spec.fill, before);
+  out.append(prefix, prefixLen);
+  out.append(digits, digitsLen);
+  out.append(spec.fill, pad - before);
+}
+
+static constexpr char DigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* Writes decimal digits ending at end; returns start */
+inline char* FormatDecimal(char* end, uint64_t value) {
+  while (value >= 100) {
+    unsigned idx = unsigned(value % 100) * 2;
+    value /= 100;
+    *--end = DigitPairs[idx + 1];
+    *--end = DigitPairs[idx];
+  }
+  if (value >= 10) {
+    unsigned idx = unsigned(value) * 2;
+    *--end = DigitPairs[idx + 1];
+    *--end = DigitPairs[idx];
+  } else {
+    *--end = char('0' + value);
+  }
+  return end;
+}
+
+inline char* FormatRadix(char* end, uint64_t value, unsigned shift, bool upper) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  uint64_t mask = (uint64_t(1) << shift) - 1;
+  do {
+    *--end = digits[value & mask];
+    value >>= shift;
+  } while (value);
+  return end;
+}
+
+inline void WriteInteger(FormatBuffer& out, const FieldSpec& spec, uint64_t magnitude, bool negative) {
+  if (spec.type == 'c') {
+    char c = char(magnitude);
+    WritePadded(out, spec, &c, 1, '<');
+    return;
+  }
+  char buf[72];
+  char* end = buf + sizeof(buf);
+  char* begin;
+  char prefix[4];
+  size_t prefixLen = 0;
+  if (negative)
+    prefix[prefixLen++] = '-';
+  else if (spec.sign == '+' || spec.sign == ' ')
+    prefix[prefixLen++] = spec.sign;
+  switch (spec.type) {
+  case 'x':
+  case 'X':
+    begin = FormatRadix(end, magnitude, 4, spec.type == 'X');
+    if (spec.alt) {
+      prefix[prefixLen++] = '0';
+      prefix[prefixLen++] = spec.type;
+    }
+    break;
+  case 'o':
+    begin = FormatRadix(end, magnitude, 3, false);
+    if (spec.alt && magnitude)
+      prefix[prefixLen++] = '0';
+    break;
+  case 'b':
+    begin = FormatRadix(end, magnitude, 1, false);
+    if (spec.alt) {
+      prefix[prefixLen++] = '0';
+      prefix[prefixLen++] = 'b';
+    }
+    break;
+  default:
+    begin = FormatDecimal(end, magnitude);
+    break;
+  }
+  WriteNumber(out, spec, prefix, prefixLen, begin, size_t(end - begin));
+}
+
+template <typename T>
+inline void WriteFloat(FormatBuffer& out, const FieldSpec& spec, T value) {
+  char buf[512];
+  char* begin = buf;
+  char prefix[1];
+  size_t prefixLen = 0;
+  if (std::signbit(value)) {
+    prefix[prefixLen++] = '-';
+    value = -value;
+  } else if (spec.sign == '+' || spec.sign == ' ') {
+    prefix[prefixLen++] = spec.sign;
+  }
+  bool upper = spec.type >= 'A' && spec.type <= 'Z';
+  std::to_chars_result res;
+  if (!std::isfinite(value)) {
+    const char* text = std::isnan(value) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+    WritePadded(out, spec, text, 3, '>');
+    return;
+  }
+  switch (spec.type) {
+  case 'f':
+  case 'F':
+    res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed,
+                        spec.precision >= 0 ? spec.precision : 6);
+    break;
+  case 'e':
+  case 'E':
+    res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::scientific,
+                        spec.precision >= 0 ? spec.precision : 6);
+    break;
+  case 'g':
+  case 'G':
+    res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general,
+                        spec.precision >= 0 ? spec.precision : 6);
+    break;
+  case 'a':
+  case 'A':
+    res = spec.precision >= 0
+              ? std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::hex, spec.precision)
+              : std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::hex);
+    break;
+  default:
+    /* Shortest representation that round-trips */
+    res = spec.precision >= 0
+              ? std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, spec.precision)
+              : std::to_chars(buf, buf + sizeof(buf), value);
+    break;
+  }
+  if (res.ec != std::errc()) {
+    WritePadded(out, spec, "?", 1, '>');
+    return;
+  }
+  if (upper)
+    for (char* p = begin; p < res.ptr; ++p)
+      if (*p >= 'a' && *p <= 'z')
+        *p -= 'a' - 'A';
+  WriteNumber(out, spec, prefix, prefixLen, begin, size_t(res.ptr - begin));
+}
+
+inline void WriteString(FormatBuffer& out, const FieldSpec& spec, std::string_view str) {
+  if (spec.precision >= 0 && size_t(spec.precision) < str.size())
+    str = str.substr(0, spec.precision);
+  WritePadded(out, spec, str.data(), str.size(), '<');
+}
+
+template <typename T>
+inline void WriteArg(FormatBuffer& out, const FieldSpec& spec, const T& arg) {
+  constexpr ArgKind kind = KindOf<T>();
+  if constexpr (kind == ArgKind::Bool) {
+    if (spec.type && spec.type != 's')
+      WriteInteger(out, spec, arg ? 1 : 0, false);
+    else
+      WriteString(out, spec, arg ? "true" : "false");
+  } else if constexpr (kind == ArgKind::Char) {
+    if (spec.type && spec.type != 's' && spec.type != 'c')
+      WriteInteger(out, spec, uint64_t((unsigned char)arg), false);
+    else
+      WritePadded(out, spec, &arg, 1, '<');
+  } else if constexpr (kind == ArgKind::Signed) {
+    int64_t v = int64_t(arg);
+    WriteInteger(out, spec, v < 0 ? 0 - uint64_t(v) : uint64_t(v), v < 0);
+  } else if constexpr (kind == ArgKind::Unsigned) {
+    WriteInteger(out, spec, uint64_t(arg), false);
+  } else if constexpr (kind == ArgKind::Float) {
+    WriteFloat(out, spec, arg);
+  } else if constexpr (kind == ArgKind::String) {
+    if constexpr (std::is_pointer_v<T>) {
+      if (!arg) {
+        WriteString(out, spec, "(null)");
+        return;
+      }
+    }
+    WriteString(out, spec, std::string_view(arg));
+  } else {
+    FieldSpec ptrSpec = spec;
+    ptrSpec.type = 'x';
+    ptrSpec.alt = true;
+    WriteInteger(out, ptrSpec, uint64_t((uintptr_t)(const void*)arg), false);
+  }
+}
+
+} // namespace detail
+
+/**
+ * @brief Brace format string parsed and checked against its argument types at compile time
+ */
+template <typename... Args>
+struct FormatString {
+  const char* str;
+  size_t len;
+  size_t tail = 0; /**< Literal text after the last field */
+  bool hasEscapes = false;
+  detail::Field fields[sizeof...(Args) ? sizeof...(Args) : 1];
+
+  template <size_t N>
+  consteval FormatString(const char (&s)[N]) : str(s), len(N - 1), fields() {
+    constexpr detail::ArgKind kinds[] = {detail::KindOf<Args>()..., detail::ArgKind::Bool};
+    size_t field = 0;
+    size_t litBegin = 0;
+    for (size_t pos = 0; pos < len;) {
+      if (s[pos] == '}') {
+        if (pos + 1 >= len || s[pos + 1] != '}')
+          detail::FormatErrorUnbalancedBrace();
+        hasEscapes = true;
+        pos += 2;
+      } else if (s[pos] != '{') {
+        ++pos;
+      } else if (pos + 1 < len && s[pos + 1] == '{') {
+        hasEscapes = true;
+        pos += 2;
+      } else {
+        if (field >= sizeof...(Args))
+          detail::FormatErrorTooFewArguments();
+        detail::Field& f = fields[field];
+        f.litBegin = litBegin;
+        f.litEnd = pos;
+        ++pos;
+        if (pos < len && s[pos] == ':')
+          pos = detail::ParseSpec(s, pos + 1, len, f.spec);
+        else if (pos < len && s[pos] == '}')
+          ++pos;
+        else
+          detail::FormatErrorBadSpec();
+        if (!detail::TypeAccepts(kinds[field], f.spec.type))
+          detail::FormatErrorTypeMismatch();
+        litBegin = pos;
+        ++field;
+      }
+    }
+    if (field != sizeof...(Args))
+      detail::FormatErrorTooManyArguments();
+    tail = litBegin;
+  }
+};
+
+namespace detail {
+
+inline void WriteLiteral(FormatBuffer& out, const char* str, size_t begin, size_t end, bool hasEscapes) {
+  if (!hasEscapes) {
+    out.append(str + begin, end - begin);
+    return;
+  }
+  for (size_t pos = begin; pos < end; ++pos) {
+    out.append(str + pos, 1);
+    if ((str[pos] == '{' || str[pos] == '}') && pos + 1 < end && str[pos + 1] == str[pos])
+      ++pos;
+  }
+}
+
+template <typename... Args, size_t... I>
+inline void FormatFields(FormatBuffer& out, const FormatString<Args...>& fmt, std::index_sequence<I...>,
+                         const Args&... args) {
+  ((WriteLiteral(out, fmt.str, fmt.fields[I].litBegin, fmt.fields[I].litEnd, fmt.hasEscapes),
+    WriteArg(out, fmt.fields[I].spec, args)),
+   ...);
+}
+
+} // namespace detail
+
+/**
+ * @brief Render a brace format string and arguments into a buffer
+ * @param out Destination, appended to
+ * @param fmt Format string, validated at compile time
+ * @param args Values for each replacement field, in order
+ */
+template <typename... Args>
+inline void FormatTo(detail::FormatBuffer& out, const FormatString<std::type_identity_t<Args>...>& fmt,
+                     const Args&... args) {
+  detail::FormatFields<Args...>(out, fmt, std::index_sequence_for<Args...>(), args...);
+  detail::WriteLiteral(out, fmt.str, fmt.tail, fmt.len, fmt.hasEscapes);
+}
+
+/**
+ * @brief Render a brace format string and arguments into a std::string
+ */
+template <typename... Args>
+inline std::string Format(const FormatString<std::type_identity_t<Args>...>& fmt, const Args&... args) {
+  detail::FormatBuffer buf;
+  FormatTo<Args...>(buf, fmt, args...);
+  return std::string(buf.data() ? buf.data() : "", buf.size());
+}
+
+} // namespace logvisor
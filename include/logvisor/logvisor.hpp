@@ -4,10 +4,15 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <atomic>
 #include <memory>
+#include <initializer_list>
+#include <string_view>
 #include <mutex>
+#include "logvisor/format.hpp"
 
 #ifdef __SWITCH__
 #include "nxstl/mutex"
@@ -36,6 +41,59 @@ enum Level {
   Fatal    /**< Non-recoverable error message (throws exception) */
 };
 
+/**
+ * @brief Typed key/value pair attached to a structured report
+ *
+ * Keys and string values are referenced rather than copied; they only need to
+ * remain valid until the report call returns.
+ */
+struct LogField {
+  enum Type : uint8_t { Signed, Unsigned, Float, Bool, String, Pointer };
+  const char* key;
+  Type type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double f;
+    bool b;
+    const void* p;
+    struct {
+      const char* data;
+      size_t size;
+    } str;
+  };
+
+  template <typename T>
+  LogField(const char* key, const T& value) : key(key) {
+    constexpr detail::ArgKind kind = detail::KindOf<T>();
+    if constexpr (kind == detail::ArgKind::Bool) {
+      type = Bool;
+      b = value;
+    } else if constexpr (kind == detail::ArgKind::Char) {
+      type = String;
+      str = {&value, 1};
+    } else if constexpr (kind == detail::ArgKind::Signed) {
+      type = Signed;
+      i = int64_t(value);
+    } else if constexpr (kind == detail::ArgKind::Unsigned) {
+      type = Unsigned;
+      u = uint64_t(value);
+    } else if constexpr (kind == detail::ArgKind::Float) {
+      type = Float;
+      f = double(value);
+    } else if constexpr (kind == detail::ArgKind::String) {
+      std::string_view view(value);
+      type = String;
+      str = {view.data(), view.size()};
+    } else {
+      type = Pointer;
+      p = (const void*)value;
+    }
+  }
+};
+
+struct LogSink;
+
 /**
  * @brief Backend interface for receiving app-wide log events
  */
@@ -47,6 +105,34 @@ struct ILogger {
                             va_list ap) = 0;
   virtual void reportSource(const char* modName, Level severity, const char* file, unsigned linenum,
                             const wchar_t* format, va_list ap) = 0;
+  virtual void flush() {}
+
+  /**
+   * @brief Receive a report carrying typed key/value fields
+   *
+   * The default renders the fields as key=value text after the message and
+   * passes the result to reportSource() or report().
+   */
+  virtual void reportFields(const char* modName, Level severity, const char* file, unsigned linenum,
+                            const LogField* fields, size_t fieldCount, const char* format, va_list ap);
+
+  /**
+   * @brief Non-null if this logger receives records already rendered (see LogSink)
+   */
+  virtual LogSink* asSink() { return nullptr; }
+
+  /**
+   * @brief Short description shown in GetLogStats(), e.g. "file /var/log/app.log"
+   */
+  virtual std::string describe() const { return "custom"; }
+
+  std::atomic<uint64_t> m_recordsWritten{0}; /**< Records delivered to this logger, written under the log lock */
+  std::atomic<uint64_t> m_bytesWritten{0};   /**< Output bytes, as counted through countBytes() */
+
+  /**
+   * @brief Account for output written by this logger, from any thread
+   */
+  void countBytes(size_t bytes) { m_bytesWritten.fetch_add(bytes, std::memory_order_relaxed); }
 };
 
 /**
@@ -56,18 +142,156 @@ struct ILogger {
  */
 void KillProcessTree();
 
+/**
+ * @brief Identity of a thread that has registered a name or reported a log message
+ */
+struct ThreadInfo {
+  const char* name; /**< Registered name, or nullptr; remains valid after the thread exits */
+  uint64_t osId;    /**< Native OS thread ID */
+  uint32_t seqId;   /**< Small sequential ID in order of first use */
+};
+
+/**
+ * @brief A report rendered once and shared by every LogSink
+ */
+struct LogRecord {
+  const char* modName;
+  Level severity;
+  const char* file;        /**< Source file, or nullptr */
+  unsigned linenum;
+  const char* sourceInfo;  /**< "file:line" as printed in text headers, or nullptr */
+  uint64_t uptimeNs;       /**< Time since logvisor started, from the active ClockSource */
+  int64_t wallNs;          /**< Nanoseconds since the Unix epoch */
+  uint64_t frameIndex;
+  ThreadInfo thread;
+  std::string_view message; /**< UTF-8 text without a trailing newline */
+  const LogField* fields;   /**< Typed key/value fields, not included in message */
+  size_t fieldCount;
+};
+
+/**
+ * @brief Logger that receives each report as a LogRecord
+ *
+ * Reports are formatted once and the record is passed to every sink in MainLoggers,
+ * so the cost of a report grows with the bytes written rather than with the number
+ * of sinks. Loggers implementing only ILogger keep receiving the format string and
+ * arguments. Sinks are called under the log lock.
+ */
+struct LogSink : public ILogger {
+  virtual void write(const LogRecord& record) = 0;
+
+  /**
+   * @brief Receive consecutive records at once, e.g. a frame collected by EnableFrameBatching()
+   *
+   * The default calls write() for each record; sinks override it to emit the batch with one write.
+   */
+  virtual void writeBatch(const LogRecord* records, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+      write(records[i]);
+  }
+
+  /* Driven through ILogger directly, a sink renders the record itself */
+  void report(const char* modName, Level severity, const char* format, va_list ap) override;
+  void report(const char* modName, Level severity, const wchar_t* format, va_list ap) override;
+  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                    va_list ap) override;
+  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                    va_list ap) override;
+  void reportFields(const char* modName, Level severity, const char* file, unsigned linenum, const LogField* fields,
+                    size_t fieldCount, const char* format, va_list ap) override;
+  LogSink* asSink() final { return this; }
+};
+
 /**
  * @brief Assign calling thread a descriptive name
- * @param name Descriptive thread name
+ * @param name Descriptive thread name (copied), or nullptr to release the current name
+ *
+ * The identity is kept in thread-local storage, so log headers are rendered
+ * without any lookup. It is removed from the live list when the thread exits.
+ * Names are kept for the process lifetime, up to 1024 distinct ones; threads
+ * given a name beyond that are logged as unnamed.
  */
 void RegisterThreadName(const char* name);
 
 /**
- * @brief Centralized logger vector
+ * @brief Snapshot the identities of all live threads known to logvisor
+ * @return One entry per thread that has registered a name or reported a log message
+ */
+std::vector<ThreadInfo> GetLiveThreads();
+
+/**
+ * @brief Registry of loggers that receive reports
  *
- * All loggers added to this vector will receive reports as they occur
+ * Every change publishes a new immutable list, so reporters iterate a snapshot
+ * without locking while loggers are added or removed on other threads. Loggers
+ * taken out of the list are destroyed once no snapshot refers to them.
  */
-extern std::vector<std::unique_ptr<ILogger>> MainLoggers;
+class LoggerList {
+public:
+  struct Set;
+  struct Hazard;
+
+  /**
+   * @brief Loggers registered at the time the snapshot was taken, kept alive until it is destroyed
+   */
+  class Snapshot {
+    const Set* m_set;
+    Hazard* m_hazard;
+
+  public:
+    explicit Snapshot(const LoggerList& list);
+    ~Snapshot();
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+    ILogger* const* begin() const;
+    ILogger* const* end() const;
+  };
+
+  constexpr LoggerList() = default;
+  ~LoggerList();
+  LoggerList(const LoggerList&) = delete;
+  LoggerList& operator=(const LoggerList&) = delete;
+
+  /**
+   * @brief Register a logger, taking ownership of it
+   */
+  void emplace_back(ILogger* logger);
+  void push_back(std::unique_ptr<ILogger> logger) { emplace_back(logger.release()); }
+
+  /**
+   * @brief Unregister a logger; it is destroyed once no snapshot refers to it
+   * @return false if the logger was not registered
+   */
+  bool remove(ILogger* logger);
+
+  /**
+   * @brief Unregister all loggers
+   */
+  void clear();
+
+  bool empty() const { return m_count.load(std::memory_order_relaxed) == 0; }
+  size_t size() const { return m_count.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Take a lock-free snapshot for iteration, e.g. for (ILogger* logger : MainLoggers.snapshot())
+   */
+  Snapshot snapshot() const { return Snapshot(*this); }
+
+private:
+  void publish(Set* set);
+
+  std::atomic<const Set*> m_current{nullptr};
+  std::atomic<size_t> m_count{0};
+  std::mutex m_writeMutex;             /**< Serializes registration only; readers never take it */
+  std::vector<const Set*> m_retired;   /**< Replaced sets that may still be protected by a snapshot */
+};
+
+/**
+ * @brief Centralized logger list
+ *
+ * All loggers added to this list will receive reports as they occur
+ */
+extern LoggerList MainLoggers;
 
 /**
  * @brief Centralized error counter
@@ -109,16 +333,214 @@ extern LogMutex _LogMutex;
  */
 static inline std::unique_lock<std::recursive_mutex> LockLog() { return _LogMutex.lock(); }
 
-extern uint64_t _LogCounter;
+extern std::atomic<uint64_t> _LogCounter;
 
 /**
  * @brief Get current count of logging events
  * @return Log Count
  */
-static inline uint64_t GetLogCounter() { return _LogCounter; }
+static inline uint64_t GetLogCounter() { return _LogCounter.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Snapshot of logging activity since startup
+ *
+ * Module counters are kept in per-thread shards written without atomic read-modify-write
+ * operations, and are summed when the snapshot is taken. Sink record counts are written
+ * under the log lock, also without read-modify-writes; sink byte counts are added
+ * atomically, since some loggers write from a thread of their own. Histogram bucket i
+ * counts durations in [2^i, 2^(i+1)) nanoseconds; bucket 0 also counts zero.
+ */
+struct LogStats {
+  static constexpr size_t HistogramBuckets = 40;
+
+  struct ModuleStats {
+    std::string name;
+    uint64_t reports[4];  /**< Delivered or queued reports, indexed by Level */
+    uint64_t latencyNs;   /**< Total time spent in synchronous reports, including lock waits */
+  };
+  struct SinkStats {
+    std::string description; /**< From ILogger::describe() */
+    uint64_t records;
+    uint64_t bytes;
+  };
+
+  std::vector<ModuleStats> modules; /**< Sorted by total reports, highest first */
+  std::vector<SinkStats> sinks;     /**< Currently registered loggers, in registration order */
+  uint64_t reports = 0;             /**< Sum of all module reports */
+  uint64_t errors = 0;              /**< Current ErrorCount */
+  uint64_t suppressed = 0;          /**< Reports dropped by a SitePolicy */
+  uint64_t asyncDropped = 0;        /**< Records dropped by asynchronous queue overflow */
+  uint64_t lockWaits = 0;           /**< Acquisitions of the log lock by reporting threads */
+  uint64_t lockWaitNs = 0;          /**< Total time reporting threads spent acquiring the log lock */
+  uint64_t latency[HistogramBuckets] = {};  /**< Synchronous report latency, lock wait included */
+  uint64_t lockWait[HistogramBuckets] = {}; /**< Log lock acquisition time */
+
+  /**
+   * @brief Approximate percentile of a histogram, as the upper bound of the bucket reaching it
+   */
+  static uint64_t Percentile(const uint64_t (&histogram)[HistogramBuckets], double fraction);
+};
+
+/**
+ * @brief Collect logging counters from all threads
+ */
+LogStats GetLogStats();
+
+/**
+ * @brief Report a LogStats summary through the "logvisor" module at a fixed interval
+ * @param intervalMs Time between summaries
+ * @param severity Level of the summary reports
+ */
+void EnableLogStatsDump(unsigned intervalMs, Level severity = Info);
+
+/**
+ * @brief Stop periodic LogStats summaries
+ */
+void DisableLogStatsDump();
 
 /**
- * @brief Restore centralized logger vector to default state (silent operation)
+ * @brief Source of the timestamp captured with each record
+ */
+enum class ClockSource {
+  Steady,          /**< std::chrono::steady_clock (default) */
+  MonotonicCoarse, /**< CLOCK_MONOTONIC_COARSE; scheduler-tick resolution without a system call (Linux only) */
+  TSC              /**< Invariant time stamp counter, calibrated against the steady clock (x86 only) */
+};
+
+/**
+ * @brief Select the clock sampled for each record
+ * @param source Clock to use; falls back to ClockSource::Steady where unsupported
+ * @return The source actually in effect
+ *
+ * Selecting ClockSource::TSC calibrates the counter, which takes about 20 ms.
+ */
+ClockSource SetClockSource(ClockSource source);
+
+/**
+ * @brief Form of the timestamp at the start of text headers
+ */
+enum class TimestampStyle {
+  Uptime,    /**< Seconds since startup, "12.3456" (default) */
+  LocalTime, /**< Local wall-clock time, "YYYY-mm-dd HH:MM:SS.ffffff" */
+  UTC        /**< UTC wall-clock time, "YYYY-mm-dd HH:MM:SS.ffffffZ" */
+};
+
+/**
+ * @brief Select how text loggers print record timestamps
+ *
+ * The date and time of day are formatted once per second and reused, so only the
+ * sub-second digits are written per record. Binary and structured loggers always
+ * store both uptime and wall-clock time as integer nanoseconds.
+ */
+void SetTimestampStyle(TimestampStyle style);
+
+/**
+ * @brief Behavior of asynchronous logging when reports outpace the writer thread
+ */
+enum class AsyncOverflow {
+  Block,      /**< Reporting thread waits for the writer to free a slot */
+  DropNewest, /**< Record being reported is discarded */
+  DropOldest  /**< Oldest queued record is discarded to make room */
+};
+
+/**
+ * @brief Hand log reports off to a background writer thread
+ * @param capacity Queue length in records, rounded up to a power of two
+ * @param overflow Behavior when the queue is full
+ *
+ * Messages are formatted on the reporting thread into a bounded lock-free queue
+ * and delivered to MainLoggers by a dedicated writer thread. Fatal reports and
+ * process exit drain the queue first. Dropped records are summarized with a
+ * Warning once the writer catches up. Messages longer than a queue record
+ * (1023 bytes) are delivered synchronously, after the records queued before them.
+ * If asynchronous logging is already enabled, this is a no-op.
+ */
+void EnableAsyncLogging(size_t capacity = 1024, AsyncOverflow overflow = AsyncOverflow::Block);
+
+/**
+ * @brief Drain the asynchronous queue, stop the writer thread and resume synchronous reporting
+ */
+void DisableAsyncLogging();
+
+/**
+ * @brief Deliver all queued records to MainLoggers and flush their buffered output
+ */
+void FlushLog();
+
+/**
+ * @brief Hold records in per-thread buffers and deliver them to sinks once per frame
+ * @param maxBytesPerThread Buffered text at which a thread delivers all pending records early
+ *
+ * Synchronous reports below Error are rendered once and kept until EndFrame(), which
+ * merges every thread's records in timestamp order and passes them to each LogSink
+ * through writeBatch(); the console and file loggers emit a frame with a single write.
+ * Error and Fatal reports deliver everything pending ahead of themselves. Loggers that
+ * are not sinks receive the same frame one record at a time, as preformatted text with
+ * each record's original timestamp and thread. Reports taken by the asynchronous queue
+ * are not batched. GetLogCounter() counts batched records once they are delivered.
+ */
+void EnableFrameBatching(size_t maxBytesPerThread = 1024 * 1024);
+
+/**
+ * @brief Deliver pending records and return to per-report delivery
+ */
+void DisableFrameBatching();
+
+/**
+ * @brief Deliver the records collected during the current frame
+ *
+ * Call once per main-loop iteration, where FrameIndex is advanced.
+ */
+void EndFrame();
+
+extern std::atomic_bool _AsyncLogging;
+bool _ReportAsync(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                  va_list ap);
+bool _ReportAsync(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                  va_list ap);
+
+/**
+ * @brief Keep the most recent reports of each thread in memory for crash diagnostics
+ * @param recordsPerThread Ring length per thread; messages are truncated to a fixed slot size
+ * @param minLevel Lowest severity captured, whether or not any logger would receive it
+ *
+ * Enabled by default with 64 records per thread at Warning, above the default module
+ * level, so a report discarded by Module::level() still costs a single comparison.
+ * Reports at or above minLevel are captured even when Module::level(), a SitePolicy or
+ * an empty logger list keeps them from the loggers; those are rendered into the ring
+ * only. Lowering minLevel below a module's level keeps that module's filtered context
+ * for a crash, at the cost of rendering it on every report. The rings are dumped to
+ * stderr by the abort signal handlers and logvisorAbort().
+ */
+void EnableFlightRecorder(unsigned recordsPerThread = 64, Level minLevel = Info);
+
+/**
+ * @brief Stop capturing reports into flight recorder rings
+ */
+void DisableFlightRecorder();
+
+/**
+ * @brief Write the contents of all flight recorder rings to a file descriptor, oldest first
+ * @param fd Destination descriptor
+ *
+ * Async-signal-safe: uses only write(2), with no locking or allocation.
+ */
+void DumpFlightRecorder(int fd);
+
+void _ReportFields(const char* modName, Level severity, const char* file, unsigned linenum, const LogField* fields,
+                   size_t fieldCount, const char* format, va_list ap);
+void _ReportSync(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                 va_list ap);
+void _ReportSync(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                 va_list ap);
+
+extern std::atomic<int> _FlightLevel;
+void _RecordFlight(const char* modName, Level severity, const char* format, va_list ap);
+void _RecordFlight(const char* modName, Level severity, const wchar_t* format, va_list ap);
+void _RecordFlightText(const char* modName, Level severity, const char* text);
+
+/**
+ * @brief Restore centralized logger list to default state (silent operation)
  */
 static inline void UnregisterLoggers() { MainLoggers.clear(); }
 
@@ -130,6 +552,41 @@ static inline void UnregisterLoggers() { MainLoggers.clear(); }
  */
 void RegisterConsoleLogger();
 
+/**
+ * @brief Naming scheme for rotated-out log files
+ */
+enum class FileArchiveNaming {
+  Numbered,   /**< <path>.1 is the newest archive, up to <path>.<maxArchives> */
+  Timestamped /**< <path>.YYYYmmdd-HHMMSS of the rotation time */
+};
+
+/**
+ * @brief On-disk encoding of file logger output
+ */
+enum class FileCompression {
+  None, /**< Plain text */
+  LZ4   /**< Independently decodable LZ4 blocks; read back with logvisor-cat */
+};
+
+/**
+ * @brief Buffering, flushing and rotation settings for file loggers
+ *
+ * A crash by signal drops up to bufferSize bytes of records that weren't flushed yet. In their
+ * place, uncompressed logs get the flight recorder's rings and the FATAL line appended.
+ */
+struct FileLoggerOptions {
+  size_t bufferSize = 64 * 1024; /**< User-space write buffer; 0 flushes every record */
+  Level flushLevel = Error;      /**< Records of this severity or higher are flushed immediately */
+  unsigned flushInterval = 1000; /**< Flush when a record arrives this many ms after the last flush; 0 disables */
+  uint64_t rotateSize = 0;       /**< Rotate once the file reaches this many bytes; 0 disables */
+  unsigned rotateInterval = 0;   /**< Rotate after this many wall-clock seconds; 0 disables */
+  FileArchiveNaming archiveNaming = FileArchiveNaming::Numbered;
+  unsigned maxArchives = 5; /**< Numbered archives kept; older ones are deleted */
+  FileCompression compression = FileCompression::None;
+  size_t blockSize = 256 * 1024; /**< Text collected per compressed block; flushes also end a block */
+  size_t indexInterval = 0;      /**< Text per <path>.idx entry for logvisor-query; 0 or compression disables */
+};
+
 /**
  * @brief Construct and register a file logger
  * @param filepath Path to write the file
@@ -138,11 +595,195 @@ void RegisterConsoleLogger();
  */
 void RegisterFileLogger(const char* filepath);
 
+/**
+ * @brief Construct and register a file logger with explicit buffering and rotation
+ * @param filepath Path to write the file
+ * @param options Buffering, flushing and rotation settings
+ *
+ * The file stays open for the lifetime of the logger. When rotation is enabled, a
+ * helper thread closes rotated-out files and prepares the next one as <path>.next,
+ * so a rotation only renames files and never waits on a flush or an open.
+ */
+void RegisterFileLogger(const char* filepath, const FileLoggerOptions& options);
+
+/**
+ * @brief Construct and register a binary logger with deferred formatting
+ * @param filepath Path to write the file
+ *
+ * Records store the identity of the format string and the raw argument values
+ * rather than formatted text; the logvisor-decode tool renders them back into
+ * the file logger's text form. Format strings are identified by address, so they
+ * must be string literals or otherwise remain unchanged for the process lifetime.
+ */
+void RegisterBinaryLogger(const char* filepath);
+
+/**
+ * @brief Segment sizing and retention for mapped loggers
+ */
+struct MappedLoggerOptions {
+  size_t segmentSize = 16 * 1024 * 1024; /**< Bytes preallocated and mapped per segment */
+  unsigned maxSegments = 0;              /**< Segments kept on disk; older ones are deleted; 0 keeps all */
+};
+
+/**
+ * @brief Construct and register a logger writing one JSON object per line
+ * @param filepath Path to write the file
+ * @param options Buffering, flushing and rotation settings
+ *
+ * Each record carries module, severity, uptime_ns, frame, thread, tid, source file
+ * and line when known, the message, and any structured fields as a nested "fields"
+ * object. Records are encoded into a reused per-thread buffer without allocating.
+ */
+void RegisterJsonLogger(const char* filepath, const FileLoggerOptions& options = FileLoggerOptions());
+
+/**
+ * @brief Construct and register a logger writing into memory-mapped, preallocated segments
+ * @param pathPrefix Segments are written to <pathPrefix>.000001, <pathPrefix>.000002, ...
+ * @param options Segment sizing and retention
+ *
+ * Records are copied straight into a shared file mapping, so writing one costs no
+ * system call and anything written survives a crash of the process. A new segment
+ * is started when the current one fills; numbering continues after any segments
+ * already on disk. Use the logvisor-segcat tool to read segments back as text.
+ */
+void RegisterMappedLogger(const char* pathPrefix, const MappedLoggerOptions& options = MappedLoggerOptions());
+
+/**
+ * @brief Wire format of records sent to a local collector socket
+ */
+enum class SocketProtocol {
+  Syslog,  /**< RFC 5424 messages; fields become structured data, streams use RFC 6587 octet counting */
+  Journald /**< journald native protocol; streams separate entries with an empty line as in the export format */
+};
+
+/**
+ * @brief Unix domain socket type used to reach the collector
+ */
+enum class SocketType {
+  Datagram, /**< One record per datagram, sent in batches with sendmmsg() where available */
+  Stream    /**< Records are framed and sent in batches with writev() */
+};
+
+/**
+ * @brief Framing, batching and reconnection settings for socket loggers
+ */
+struct SocketLoggerOptions {
+  SocketProtocol protocol = SocketProtocol::Syslog;
+  SocketType type = SocketType::Datagram;
+  const char* appName = nullptr;    /**< APP-NAME / SYSLOG_IDENTIFIER; defaults to the program name */
+  unsigned facility = 1;            /**< Syslog facility code; 1 is user-level */
+  size_t maxBatch = 64;             /**< Records handed to the kernel per system call, at most 1024 */
+  unsigned batchInterval = 50;      /**< Longest a record waits for a batch to fill, in ms; 0 sends at once */
+  size_t queueCapacity = 8192;      /**< Records held while the collector is away; further ones are dropped */
+  unsigned reconnectInterval = 500; /**< Delay between connection attempts, in ms */
+};
+
+/**
+ * @brief Construct and register a logger sending records to a local collector over a Unix domain socket
+ * @param socketPath Filesystem path of the collector's socket, e.g. /dev/log or /run/systemd/journal/socket
+ * @param options Wire format, batching and reconnection settings
+ *
+ * Reporting threads only render records into a queue; a sender thread connects, sends
+ * the queue in batches and reconnects after the collector restarts. Records reported
+ * while it is away are held up to queueCapacity, counting those the sender has taken,
+ * and sent once it returns; records beyond that are dropped and summarized with a
+ * Warning once there is room again. Records of Error or higher severity are sent
+ * without waiting for the batch interval. Only available on POSIX platforms; a no-op
+ * elsewhere.
+ */
+void RegisterSocketLogger(const char* socketPath, const SocketLoggerOptions& options = SocketLoggerOptions());
+
+/**
+ * @brief Construct and register a logger handing raw records to another process through shared memory
+ * @param name POSIX shared memory object name, e.g. "/mygame-log"
+ * @param capacity Ring size in bytes, rounded up to a power of two
+ *
+ * Records are copied unformatted into a ring that the logvisor-collector tool maps
+ * and writes out as file logger text, so headers are never rendered and no file is
+ * touched in this process. The two processes share no locks: a full ring drops the
+ * record rather than waiting, and the collector reports how many were dropped.
+ * Everything published before a crash stays readable, and the collector notices when
+ * this process exits. Any ring of the same name left by an earlier run is replaced.
+ * Only available on POSIX platforms; a no-op elsewhere.
+ */
+void RegisterRingLogger(const char* name, size_t capacity = 4 * 1024 * 1024);
+
+/**
+ * @brief Submission depth, buffering and I/O mode for io_uring file loggers
+ */
+struct UringLoggerOptions {
+  unsigned queueDepth = 4;        /**< Buffer writes in flight at once, at most 256; the pool holds two more */
+  size_t bufferSize = 256 * 1024; /**< Bytes per pooled buffer, rounded up to 4 KiB; a full buffer is one write */
+  bool registerBuffers = true;    /**< Register the pool with the kernel so writes skip pinning pages each time */
+  bool directIO = false;          /**< Bypass the page cache with O_DIRECT where the file system supports it */
+  bool useIoUring = true;         /**< False always writes through the fallback writer thread */
+  Level flushLevel = Error;       /**< Records of this severity or higher submit the current buffer at once */
+  unsigned flushInterval = 1000;  /**< Submit when a record arrives this many ms after the last submit; 0 disables */
+};
+
+/**
+ * @brief Construct and register a file logger whose writes complete asynchronously
+ * @param filepath Path to write the file; text is appended in the file logger's format
+ * @param options Submission depth, buffering and I/O mode
+ *
+ * Records are rendered into a fixed pool of page-aligned buffers. A full buffer is
+ * submitted through io_uring at its file offset and reporting continues in the next
+ * one, so a slow disk only holds up reporting once every buffer is in flight. Where
+ * io_uring is unavailable (older kernels, seccomp filters, io_uring_disabled) the
+ * buffers are written by a writer thread instead. Direct I/O writes whole 4 KiB
+ * blocks; the zero padding of the last block is truncated away when the logger is
+ * destroyed, so a crash can leave up to one block of zeros at the end of the file.
+ * The file must not be written by anything else while the logger is open. Fatal
+ * records and FlushLog() wait for every submitted write to complete. Only available
+ * on POSIX platforms; a no-op elsewhere.
+ */
+void RegisterUringLogger(const char* filepath, const UringLoggerOptions& options = UringLoggerOptions());
+
 /**
  * @brief Register signal handlers with system for common client exceptions
+ *
+ * Also builds the symbolizer index, so crash backtraces resolve without reading files.
  */
 void RegisterStandardExceptions();
 
+/**
+ * @brief Symbol containing a code address, as resolved from loaded ELF objects
+ */
+struct SymbolInfo {
+  const char* symbol;  /**< Mangled symbol name, or nullptr; valid for the process lifetime */
+  const char* object;  /**< Path of the containing executable or shared library, or nullptr */
+  uintptr_t offset;    /**< Distance from the symbol start, or from the object base without a symbol */
+};
+
+/**
+ * @brief Build the symbol index for all currently loaded objects
+ *
+ * Otherwise built lazily on first use. Objects loaded later are indexed when an
+ * address inside them is first looked up. Crash backtraces never build or refresh
+ * the index and show bare addresses for objects it does not cover; this is called
+ * by RegisterStandardExceptions().
+ */
+void PrepareSymbolizer();
+
+/**
+ * @brief Resolve a code address to its enclosing symbol without spawning tools
+ * @param address Return address, e.g. from backtrace()
+ * @param info Receives the symbol, object and offset
+ * @return false if the address is not inside any loaded object
+ *
+ * Lookups are lock-free binary searches over a sorted index of the symbol tables.
+ * Only Linux reads ELF symbol tables directly; other POSIX platforms fall back to dladdr().
+ */
+bool Symbolize(const void* address, SymbolInfo& info);
+
+/**
+ * @brief Capture and symbolize the calling thread's stack
+ * @param skipFrames Innermost frames to omit, beyond this function itself
+ * @param maxFrames Most frames to include
+ * @return One demangled "#n address symbol+offset (object)" line per frame
+ */
+std::string FormatBacktrace(unsigned skipFrames = 0, unsigned maxFrames = 64);
+
 #if _WIN32
 /**
  * @brief Spawn an application-owned cmd.exe window for displaying console output
@@ -160,16 +801,212 @@ void CreateWin32Console();
  */
 void RegisterFileLogger(const wchar_t* filepath);
 
+/**
+ * @brief Construct and register a file logger with explicit buffering and rotation (wchar_t version)
+ * @param filepath Path to write the file
+ * @param options Buffering, flushing and rotation settings
+ */
+void RegisterFileLogger(const wchar_t* filepath, const FileLoggerOptions& options);
+
 #endif
 
+/**
+ * @brief Suppression policy for a single report call site
+ */
+struct SitePolicy {
+  enum Kind : uint32_t {
+    Unlimited, /**< Every report is delivered */
+    PerSecond, /**< At most n reports per second; a count of suppressed reports follows */
+    Sample,    /**< One in every n reports is delivered */
+    Collapse   /**< Consecutive reports from one site on one thread are replaced by a "repeated" summary */
+  };
+  Kind kind = Unlimited;
+  uint32_t n = 0;
+
+  static constexpr SitePolicy Rate(uint32_t perSecond) { return {PerSecond, perSecond}; }
+  static constexpr SitePolicy OneIn(uint32_t every) { return {Sample, every}; }
+  static constexpr SitePolicy CollapseRepeats() { return {Collapse, 0}; }
+};
+
+/**
+ * @brief Lock-free suppression state for one report call site
+ *
+ * Declared statically at a call site (see LOGVISOR_REPORT_SITE), or looked up
+ * by format string address when a Module has a default SitePolicy.
+ */
+struct LogSite {
+  std::atomic<uint64_t> window{0};              /**< Rate limit window, in seconds of uptime plus one */
+  std::atomic<uint32_t> count{0};               /**< Reports seen in the current window or sample period */
+  std::atomic<uint64_t> suppressed{0};          /**< Reports dropped since the last summary */
+  std::atomic<Level> severity{Info};            /**< Severity of the latest suppressed report */
+  std::atomic<const char*> modName{nullptr};    /**< Module of the latest suppressed report */
+  std::atomic<const char*> format{nullptr};     /**< Narrow format of the latest suppressed report */
+  std::atomic<SitePolicy::Kind> policy{};       /**< Policy that suppressed the latest report */
+  std::atomic<bool> pending{false};             /**< Queued for a summary by FlushLog() */
+};
+
+bool _AdmitSite(LogSite& site, const SitePolicy& policy, const char* modName, Level severity, const char* format);
+bool _AdmitSite(LogSite& site, const SitePolicy& policy, const char* modName, Level severity, const wchar_t* format);
+LogSite* _SiteForKey(const void* key);
+
+class Module;
+void _RegisterModule(Module& mod);
+void _UnregisterModule(Module& mod);
+
+/**
+ * @brief Set the level of every Module whose name matches a pattern
+ * @param patterns Entries of the form "glob=Level" separated by commas, semicolons or newlines,
+ *        e.g. "boo.*=Warning,hecl=Info"; '*' and '?' are wildcards, a bare "Level" matches every
+ *        module, '#' starts a comment and level names are case-insensitive
+ * @return false if any entry was malformed; the well-formed entries are still applied
+ *
+ * The last matching entry wins. Modules constructed later pick up their level from the
+ * same patterns, and modules that no longer match any entry return to Info. The initial
+ * patterns are read from the LOGVISOR_LEVELS environment variable.
+ */
+bool SetModuleLevels(const char* patterns);
+
+/**
+ * @brief Apply module level patterns from a file and reapply them whenever it changes
+ * @param path File holding patterns in the SetModuleLevels() syntax
+ * @param pollMs Interval between checks of the file contents
+ * @param reloadSignal Signal that forces a reload (e.g. SIGHUP), or 0 for none
+ * @return false if the file could not be read; it is still watched
+ *
+ * A background thread polls the file, replacing any watch already running.
+ */
+bool WatchModuleLevels(const char* path, unsigned pollMs = 1000, int reloadSignal = 0);
+
+/**
+ * @brief Stop the thread started by WatchModuleLevels(); levels keep their current values
+ */
+void StopWatchingModuleLevels();
+
 /**
  * @brief This is constructed per-subsystem in a locally centralized fashon
  */
 class Module {
   const char* m_modName;
+  std::atomic<Level> m_level{Info};
+  std::atomic<SitePolicy> m_sitePolicy{SitePolicy()};
+
+  /* Registry links and pattern state, guarded by the registry lock */
+  Module* m_prevModule = nullptr;
+  Module* m_nextModule = nullptr;
+  bool m_patternLevel = false;
+  friend void _RegisterModule(Module& mod);
+  friend void _UnregisterModule(Module& mod);
+  friend bool SetModuleLevels(const char* patterns);
+
+  enum class Admission {
+    Drop,   /**< Discarded before any formatting */
+    Record, /**< Rendered into the flight recorder only */
+    Deliver /**< Delivered to the loggers, and captured by the flight recorder if enabled */
+  };
+
+  /* Decides a report's fate before any formatting. Anything below both the module level and
+   * the flight level is dropped with a single comparison. Errors that aren't delivered still
+   * count toward ErrorCount. An explicit site replaces the module's default SitePolicy. */
+  template <typename CharType>
+  Admission _admit(Level severity, const CharType* format, LogSite* site = nullptr,
+                   SitePolicy policy = SitePolicy()) {
+    if (severity == Fatal)
+      return Admission::Deliver;
+    Level level = m_level.load(std::memory_order_relaxed);
+    int flightLevel = _FlightLevel.load(std::memory_order_relaxed);
+    if (severity >= (level < flightLevel ? int(level) : flightLevel)) {
+      if (severity >= level && !MainLoggers.empty()) {
+        if (!site) {
+          policy = m_sitePolicy.load(std::memory_order_relaxed);
+          if (policy.kind != SitePolicy::Unlimited)
+            site = _SiteForKey(format);
+        }
+        if (!site || _AdmitSite(*site, policy, m_modName, severity, format))
+          return Admission::Deliver;
+      }
+      if (severity == Error)
+        ++ErrorCount;
+      return severity >= flightLevel ? Admission::Record : Admission::Drop;
+    }
+    if (severity == Error)
+      ++ErrorCount;
+    return Admission::Drop;
+  }
+
+  /* Delivers a message already rendered by format() or formatSource() without admitting it again */
+  void _reportRendered(Level severity, const char* file, unsigned linenum, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    if (file)
+      reportSource(severity, file, linenum, format, ap);
+    else
+      report(severity, format, ap);
+    va_end(ap);
+  }
 
 public:
-  Module(const char* modName) : m_modName(modName) {}
+  /* Admits a LOGVISOR_REPORT_SITE report against the call site's own policy */
+  template <typename CharType>
+  void _reportSite(LogSite& site, const SitePolicy& policy, Level severity, const CharType* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    Admission admission = _admit(severity, format, &site, policy);
+    if (admission == Admission::Deliver)
+      report(severity, format, ap);
+    else if (admission == Admission::Record)
+      _RecordFlight(m_modName, severity, format, ap);
+    va_end(ap);
+  }
+
+  Module(const char* modName) : m_modName(modName) { _RegisterModule(*this); }
+  ~Module() { _UnregisterModule(*this); }
+  Module(const Module&) = delete;
+  Module& operator=(const Module&) = delete;
+
+  /**
+   * @brief Set suppression policy applied to every call site of this module
+   * @param policy Rate limit, sampling or duplicate collapsing; call sites are keyed by format string address
+   *
+   * Checked before formatting and without the log lock. Suppressed Error reports still count toward ErrorCount.
+   */
+  void setSitePolicy(const SitePolicy& policy) { m_sitePolicy.store(policy, std::memory_order_relaxed); }
+
+  /**
+   * @brief Get suppression policy applied to every call site of this module
+   */
+  SitePolicy sitePolicy() const { return m_sitePolicy.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Set minimum severity reported by this module at runtime
+   * @param severity Reports below this level are kept from the loggers without locking
+   *
+   * Reports also below the flight recorder level are discarded before any formatting; the
+   * others are rendered into the flight recorder only. Fatal reports are never discarded.
+   * Error reports kept from the loggers still count toward ErrorCount.
+   */
+  void setLevel(Level severity) { m_level.store(severity, std::memory_order_relaxed); }
+
+  /**
+   * @brief Get minimum severity reported by this module
+   */
+  Level level() const { return m_level.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Test whether a report of the given severity would be delivered
+   */
+  bool isEnabled(Level severity) const { return severity >= m_level.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Test whether a report of the given severity would be delivered or kept by the flight recorder
+   */
+  bool isCaptured(Level severity) const {
+    return isEnabled(severity) || severity >= _FlightLevel.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get module name as passed at construction
+   */
+  const char* name() const { return m_modName; }
 
   /**
    * @brief Route new log message to centralized ILogger
@@ -178,32 +1015,110 @@ public:
    */
   template <typename CharType>
   inline void report(Level severity, const CharType* format, ...) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
-      return;
     va_list ap;
     va_start(ap, format);
-    report(severity, format, ap);
+    Admission admission = _admit(severity, format);
+    if (admission == Admission::Deliver)
+      report(severity, format, ap);
+    else if (admission == Admission::Record)
+      _RecordFlight(m_modName, severity, format, ap);
     va_end(ap);
   }
 
   template <typename CharType>
   inline void report(Level severity, const CharType* format, va_list ap) {
-    auto lk = LockLog();
-    ++_LogCounter;
-    if (severity == Fatal)
-      RegisterConsoleLogger();
-    for (auto& logger : MainLoggers) {
-      va_list apc;
-      va_copy(apc, ap);
-      logger->report(m_modName, severity, format, apc);
-      va_end(apc);
+    if (severity != Fatal && _AsyncLogging.load(std::memory_order_relaxed) &&
+        _ReportAsync(m_modName, severity, nullptr, 0, format, ap)) {
+      if (severity == Error) {
+        logvisorBp();
+        ++ErrorCount;
+      }
+      return;
     }
-    if (severity == Error || severity == Fatal)
-      logvisorBp();
-    if (severity == Fatal)
-      logvisorAbort();
-    else if (severity == Error)
-      ++ErrorCount;
+    _ReportSync(m_modName, severity, nullptr, 0, format, ap);
+  }
+
+  /**
+   * @brief Route new log message to centralized ILogger using type-safe brace formatting
+   * @param severity Level of log report severity
+   * @param fmt Brace format string (see format.hpp), checked against args at compile time
+   * @param args Values for each replacement field
+   *
+   * The message is rendered once into a reusable per-thread buffer.
+   */
+  template <typename... Args>
+  inline void format(Level severity, const FormatString<std::type_identity_t<Args>...>& fmt, const Args&... args) {
+    Admission admission = _admit(severity, fmt.str);
+    if (admission == Admission::Drop)
+      return;
+    detail::ScopedFormatBuffer buf;
+    FormatTo<Args...>(*buf, fmt, args...);
+    if (admission == Admission::Deliver)
+      _reportRendered(severity, nullptr, 0, "%s", buf->c_str());
+    else
+      _RecordFlightText(m_modName, severity, buf->c_str());
+  }
+
+  /**
+   * @brief Route new log message with source info to centralized ILogger using type-safe brace formatting
+   * @param severity Level of log report severity
+   * @param file Source file name from __FILE__ macro
+   * @param linenum Source line number from __LINE__ macro
+   * @param fmt Brace format string (see format.hpp), checked against args at compile time
+   * @param args Values for each replacement field
+   */
+  template <typename... Args>
+  inline void formatSource(Level severity, const char* file, unsigned linenum,
+                           const FormatString<std::type_identity_t<Args>...>& fmt, const Args&... args) {
+    Admission admission = _admit(severity, fmt.str);
+    if (admission == Admission::Drop)
+      return;
+    detail::ScopedFormatBuffer buf;
+    FormatTo<Args...>(*buf, fmt, args...);
+    if (admission == Admission::Deliver)
+      _reportRendered(severity, file, linenum, "%s", buf->c_str());
+    else
+      _RecordFlightText(m_modName, severity, buf->c_str());
+  }
+
+  /**
+   * @brief Route new log message with typed key/value fields to centralized ILogger
+   * @param severity Level of log report severity
+   * @param fields Key/value pairs, e.g. {{"user", id}, {"bytes", size}}
+   * @param format Standard printf-style format string
+   *
+   * Loggers without structured output append the fields to the message as key=value text.
+   * Delivered synchronously, after any queued asynchronous records.
+   */
+  inline void reportFields(Level severity, std::initializer_list<LogField> fields, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    Admission admission = _admit(severity, format);
+    if (admission == Admission::Deliver)
+      _ReportFields(m_modName, severity, nullptr, 0, fields.begin(), fields.size(), format, ap);
+    else if (admission == Admission::Record)
+      _RecordFlight(m_modName, severity, format, ap);
+    va_end(ap);
+  }
+
+  /**
+   * @brief Route new log message with source info and typed key/value fields to centralized ILogger
+   * @param severity Level of log report severity
+   * @param file Source file name from __FILE__ macro
+   * @param linenum Source line number from __LINE__ macro
+   * @param fields Key/value pairs, e.g. {{"user", id}, {"bytes", size}}
+   * @param format Standard printf-style format string
+   */
+  inline void reportFieldsSource(Level severity, const char* file, unsigned linenum,
+                                 std::initializer_list<LogField> fields, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    Admission admission = _admit(severity, format);
+    if (admission == Admission::Deliver)
+      _ReportFields(m_modName, severity, file, linenum, fields.begin(), fields.size(), format, ap);
+    else if (admission == Admission::Record)
+      _RecordFlight(m_modName, severity, format, ap);
+    va_end(ap);
   }
 
   /**
@@ -215,32 +1130,78 @@ public:
    */
   template <typename CharType>
   inline void reportSource(Level severity, const char* file, unsigned linenum, const CharType* format, ...) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
-      return;
     va_list ap;
     va_start(ap, format);
-    reportSource(severity, file, linenum, format, ap);
+    Admission admission = _admit(severity, format);
+    if (admission == Admission::Deliver)
+      reportSource(severity, file, linenum, format, ap);
+    else if (admission == Admission::Record)
+      _RecordFlight(m_modName, severity, format, ap);
     va_end(ap);
   }
 
   template <typename CharType>
   inline void reportSource(Level severity, const char* file, unsigned linenum, const CharType* format, va_list ap) {
-    auto lk = LockLog();
-    ++_LogCounter;
-    if (severity == Fatal)
-      RegisterConsoleLogger();
-    for (auto& logger : MainLoggers) {
-      va_list apc;
-      va_copy(apc, ap);
-      logger->reportSource(m_modName, severity, file, linenum, format, apc);
-      va_end(apc);
+    if (severity != Fatal && _AsyncLogging.load(std::memory_order_relaxed) &&
+        _ReportAsync(m_modName, severity, file, linenum, format, ap)) {
+      if (severity == Error)
+        ++ErrorCount;
+      return;
     }
-
-    if (severity == Fatal)
-      logvisorAbort();
-    else if (severity == Error)
-      ++ErrorCount;
+    _ReportSync(m_modName, severity, file, linenum, format, ap);
   }
 };
 
 } // namespace logvisor
+
+/**
+ * @brief Lowest severity compiled into LOGVISOR_REPORT and LOGVISOR_REPORT_SOURCE call sites
+ *
+ * Define before including logvisor.hpp (e.g. -DLOGVISOR_MIN_LEVEL=logvisor::Warning) to remove
+ * lower-severity reports from the build entirely. Fatal reports are always compiled in.
+ */
+#ifndef LOGVISOR_MIN_LEVEL
+#define LOGVISOR_MIN_LEVEL logvisor::Info
+#endif
+
+/**
+ * @brief Report through a Module, skipping argument evaluation when the severity is filtered
+ *
+ * Filtering happens at compile time against LOGVISOR_MIN_LEVEL and at runtime against both
+ * Module::level() and the flight recorder level; arguments are evaluated only for reports a
+ * logger or the flight recorder takes. Filtered Error reports still count toward ErrorCount.
+ */
+#define LOGVISOR_REPORT(mod, severity, ...)                                                                            \
+  do {                                                                                                                 \
+    if (((severity) == logvisor::Fatal || (severity) >= (LOGVISOR_MIN_LEVEL)) && (mod).isCaptured(severity))           \
+      (mod).report(severity, __VA_ARGS__);                                                                             \
+    else if ((severity) == logvisor::Error)                                                                            \
+      ++logvisor::ErrorCount;                                                                                          \
+  } while (0)
+
+/**
+ * @brief Report with source info through a Module, skipping argument evaluation when the severity is filtered
+ */
+#define LOGVISOR_REPORT_SOURCE(mod, severity, ...)                                                                     \
+  do {                                                                                                                 \
+    if (((severity) == logvisor::Fatal || (severity) >= (LOGVISOR_MIN_LEVEL)) && (mod).isCaptured(severity))           \
+      (mod).reportSource(severity, __FILE__, __LINE__, __VA_ARGS__);                                                   \
+    else if ((severity) == logvisor::Error)                                                                            \
+      ++logvisor::ErrorCount;                                                                                          \
+  } while (0)
+
+/**
+ * @brief Report through a Module with a suppression policy private to this call site
+ *
+ * The policy replaces the module's default SitePolicy. It is checked after severity filtering and
+ * before arguments are formatted; suppressed reports at or above the flight recorder level are
+ * still rendered into the recorder. Suppressed Error reports still count toward ErrorCount.
+ */
+#define LOGVISOR_REPORT_SITE(mod, severity, policy, ...)                                                               \
+  do {                                                                                                                 \
+    static logvisor::LogSite _lvSite;                                                                                  \
+    if (((severity) == logvisor::Fatal || (severity) >= (LOGVISOR_MIN_LEVEL)) && (mod).isCaptured(severity))           \
+      (mod)._reportSite(_lvSite, policy, severity, __VA_ARGS__);                                                       \
+    else if ((severity) == logvisor::Error)                                                                            \
+      ++logvisor::ErrorCount;                                                                                          \
+  } while (0)
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* Wire format shared by the binary logger and logvisor-decode.
+ *
+ * Each logging session writes Magic and a Version byte, followed by a stream
+ * of tagged entries; appending sessions repeat the preamble, which resets all
+ * interned ids. Strings
+ * (format strings, module names, source files, thread names) are interned:
+ * the first use emits a definition entry assigning an id, and records refer
+ * to that id afterwards. Integers are LEB128 varints (zigzag for signed). */
+
+namespace logvisor {
+namespace binlog {
+
+static constexpr char Magic[8] = {'L', 'V', 'B', 'I', 'N', 'L', 'O', 'G'};
+static constexpr uint8_t Version = 2;
+static constexpr uint8_t MinVersion = 1; /**< Version 1 records carry no wall-clock time */
+
+enum Tag : uint8_t {
+  TagFormat = 'F',  /**< id, length, bytes */
+  TagModule = 'M',  /**< id, length, bytes */
+  TagFile = 'S',    /**< id, length, bytes */
+  TagThread = 'T',  /**< id, length, bytes */
+  TagRecord = 'R',  /**< severity, module, format, uptime ns, wall ns (v2), frame, thread, file, line, arguments */
+  TagMessage = 'P', /**< as TagRecord, but with a preformatted UTF-8 string in place of format and arguments */
+};
+
+/* Argument classes, as decided by the conversion specifier and length modifier */
+enum class ArgClass { None, Signed, Unsigned, Double, LongDouble, String, WideString, Pointer, WideChar, Count };
+
+struct Spec {
+  const char* begin;     /**< Points at '%' */
+  const char* end;       /**< One past the conversion character */
+  bool starWidth;        /**< Width passed as an int argument */
+  bool starPrecision;    /**< Precision passed as an int argument */
+  int precision;         /**< Literal precision, or -1 */
+  ArgClass cls;
+  unsigned size;         /**< Native size of the integer argument in bytes */
+};
+
+/* Finds the next conversion at or after p. Returns false at end of string. "%%" yields ArgClass::None. */
+inline bool NextSpec(const char*& p, Spec& spec) {
+  while (*p && *p != '%')
+    ++p;
+  if (!*p)
+    return false;
+  spec.begin = p++;
+  spec.starWidth = false;
+  spec.starPrecision = false;
+  spec.precision = -1;
+  spec.cls = ArgClass::None;
+  spec.size = sizeof(int);
+  if (*p == '%') {
+    spec.end = ++p;
+    return true;
+  }
+  while (*p && strchr("-+ #0'", *p))
+    ++p;
+  if (*p == '*') {
+    spec.starWidth = true;
+    ++p;
+  } else {
+    while (*p >= '0' && *p <= '9')
+      ++p;
+  }
+  if (*p == '.') {
+    ++p;
+    if (*p == '*') {
+      spec.starPrecision = true;
+      ++p;
+    } else {
+      spec.precision = 0;
+      while (*p >= '0' && *p <= '9')
+        spec.precision = spec.precision * 10 + (*p++ - '0');
+    }
+  }
+  int longs = 0;
+  bool longDouble = false;
+  for (;; ++p) {
+    if (*p == 'h')
+      spec.size = spec.size == sizeof(short) ? sizeof(char) : sizeof(short);
+    else if (*p == 'l')
+      spec.size = ++longs == 1 ? sizeof(long) : sizeof(long long);
+    else if (*p == 'j')
+      spec.size = sizeof(intmax_t);
+    else if (*p == 'z')
+      spec.size = sizeof(size_t);
+    else if (*p == 't')
+      spec.size = sizeof(ptrdiff_t);
+    else if (*p == 'L')
+      longDouble = true;
+    else
+      break;
+  }
+  switch (*p) {
+  case 'd':
+  case 'i':
+    spec.cls = ArgClass::Signed;
+    break;
+  case 'u':
+  case 'o':
+  case 'x':
+  case 'X':
+    spec.cls = ArgClass::Unsigned;
+    break;
+  case 'c':
+    spec.cls = longs ? ArgClass::WideChar : ArgClass::Unsigned;
+    spec.size = sizeof(int);
+    break;
+  case 'e':
+  case 'E':
+  case 'f':
+  case 'F':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    spec.cls = longDouble ? ArgClass::LongDouble : ArgClass::Double;
+    break;
+  case 's':
+    spec.cls = longs ? ArgClass::WideString : ArgClass::String;
+    break;
+  case 'p':
+    spec.cls = ArgClass::Pointer;
+    break;
+  case 'n':
+    spec.cls = ArgClass::Count;
+    break;
+  case '\0':
+    spec.end = p;
+    return true;
+  default:
+    break;
+  }
+  spec.end = ++p;
+  return true;
+}
+
+inline uint8_t* PutVarint(uint8_t* out, uint64_t v) {
+  while (v >= 0x80) {
+    *out++ = uint8_t(v) | 0x80;
+    v >>= 7;
+  }
+  *out++ = uint8_t(v);
+  return out;
+}
+
+inline uint64_t ZigZag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t UnZigZag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+/* Returns number of bytes written to out (at most 4) */
+inline size_t EncodeUTF8(char* out, uint32_t cp) {
+  if (cp < 0x80) {
+    out[0] = char(cp);
+    return 1;
+  } else if (cp < 0x800) {
+    out[0] = char(0xC0 | (cp >> 6));
+    out[1] = char(0x80 | (cp & 0x3F));
+    return 2;
+  } else if (cp < 0x10000) {
+    out[0] = char(0xE0 | (cp >> 12));
+    out[1] = char(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = char(0x80 | (cp & 0x3F));
+    return 3;
+  } else if (cp < 0x110000) {
+    out[0] = char(0xF0 | (cp >> 18));
+    out[1] = char(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = char(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = char(0x80 | (cp & 0x3F));
+    return 4;
+  }
+  out[0] = '?';
+  return 1;
+}
+
+/* Returns false if the input is exhausted */
+inline bool GetVarint(const uint8_t*& in, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (unsigned shift = 0; in < end && shift < 64; shift += 7) {
+    uint8_t b = *in++;
+    v |= uint64_t(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+} // namespace binlog
+} // namespace logvisor
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* Block compression shared by compressing file loggers and logvisor-cat.
+ *
+ * Blocks use the LZ4 block format (greedy matching with a 4K-entry hash table),
+ * so any LZ4 block decoder can read them. A compressed file is a sequence of
+ * sessions: each starts with Magic and a Version byte, followed by frames of
+ *   uint32 rawSize, uint32 storedSize (StoredRaw set if the payload is uncompressed)
+ * in little-endian order and then storedSize payload bytes. Every frame decodes
+ * on its own, so a crash can only lose the block that was being filled. */
+
+namespace logvisor {
+namespace blockz {
+
+static constexpr char Magic[8] = {'L', 'V', 'B', 'L', 'O', 'C', 'K', 'Z'};
+static constexpr uint8_t Version = 1;
+static constexpr uint32_t StoredRaw = 0x80000000;
+static constexpr size_t FrameHeaderSize = 8;
+static constexpr size_t MaxBlockSize = 64 * 1024 * 1024; /**< Largest rawSize a logger writes */
+
+static constexpr size_t MinMatch = 4;
+static constexpr size_t LastLiterals = 5;  /**< Block always ends with at least this many literals */
+static constexpr size_t MatchSafeEnd = 12; /**< No match may start within this many bytes of the end */
+static constexpr unsigned HashLog = 12;
+static constexpr size_t MaxOffset = 65535;
+
+inline constexpr size_t CompressBound(size_t size) { return size + size / 255 + 16; }
+
+inline uint32_t Read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void PutLE32(uint8_t* p, uint32_t v) {
+  p[0] = uint8_t(v);
+  p[1] = uint8_t(v >> 8);
+  p[2] = uint8_t(v >> 16);
+  p[3] = uint8_t(v >> 24);
+}
+
+inline uint32_t GetLE32(const uint8_t* p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+inline uint32_t Hash(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HashLog); }
+
+inline uint8_t* PutLength(uint8_t* out, size_t len) {
+  for (; len >= 255; len -= 255)
+    *out++ = 255;
+  *out++ = uint8_t(len);
+  return out;
+}
+
+inline uint8_t* PutSequence(uint8_t* out, const uint8_t* literals, size_t litLen, size_t offset, size_t matchLen) {
+  uint8_t* token = out++;
+  *token = uint8_t((litLen >= 15 ? 15 : litLen) << 4);
+  if (litLen >= 15)
+    out = PutLength(out, litLen - 15);
+  memcpy(out, literals, litLen);
+  out += litLen;
+  if (!matchLen)
+    return out;
+  *out++ = uint8_t(offset);
+  *out++ = uint8_t(offset >> 8);
+  matchLen -= MinMatch;
+  *token |= uint8_t(matchLen >= 15 ? 15 : matchLen);
+  if (matchLen >= 15)
+    out = PutLength(out, matchLen - 15);
+  return out;
+}
+
+/* Compresses size bytes into out, which must hold CompressBound(size). Returns the compressed size. */
+inline size_t Compress(const uint8_t* src, size_t size, uint8_t* out) {
+  uint32_t table[1u << HashLog] = {};
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + size;
+  uint8_t* op = out;
+  if (size > MatchSafeEnd + 1) {
+    const uint8_t* matchLimit = end - MatchSafeEnd;
+    const uint8_t* matchEnd = end - LastLiterals;
+    ++ip;
+    while (ip < matchLimit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t h = Hash(sequence);
+      const uint8_t* ref = src + table[h];
+      table[h] = uint32_t(ip - src);
+      if (ref >= ip || size_t(ip - ref) > MaxOffset || Read32(ref) != sequence) {
+        /* Skip faster through data that isn't matching */
+        ip += 1 + (size_t(ip - anchor) >> 6);
+        continue;
+      }
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+      const uint8_t* mp = ip + MinMatch;
+      const uint8_t* rp = ref + MinMatch;
+      while (mp < matchEnd && *mp == *rp) {
+        ++mp;
+        ++rp;
+      }
+      op = PutSequence(op, anchor, size_t(ip - anchor), size_t(ip - ref), size_t(mp - ip));
+      ip = mp;
+      anchor = ip;
+      if (ip < matchLimit)
+        table[Hash(Read32(ip - 2))] = uint32_t(ip - 2 - src);
+    }
+  }
+  return size_t(PutSequence(op, anchor, size_t(end - anchor), 0, 0) - out);
+}
+
+/* Decodes an LZ4 block into out. Returns the decoded size, or SIZE_MAX if the block is malformed. */
+inline size_t Decompress(const uint8_t* src, size_t size, uint8_t* out, size_t capacity) {
+  const uint8_t* ip = src;
+  const uint8_t* end = src + size;
+  uint8_t* op = out;
+  uint8_t* oend = out + capacity;
+  auto getLength = [&](size_t& len) {
+    uint8_t b;
+    do {
+      if (ip >= end)
+        return false;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return true;
+  };
+  while (ip < end) {
+    uint8_t token = *ip++;
+    size_t litLen = token >> 4;
+    if (litLen == 15 && !getLength(litLen))
+      return SIZE_MAX;
+    if (litLen > size_t(end - ip) || litLen > size_t(oend - op))
+      return SIZE_MAX;
+    memcpy(op, ip, litLen);
+    ip += litLen;
+    op += litLen;
+    if (ip == end)
+      break;
+    if (end - ip < 2)
+      return SIZE_MAX;
+    size_t offset = size_t(ip[0]) | size_t(ip[1]) << 8;
+    ip += 2;
+    size_t matchLen = token & 15;
+    if (matchLen == 15 && !getLength(matchLen))
+      return SIZE_MAX;
+    matchLen += MinMatch;
+    if (!offset || offset > size_t(op - out) || matchLen > size_t(oend - op))
+      return SIZE_MAX;
+    const uint8_t* ref = op - offset;
+    for (size_t i = 0; i < matchLen; ++i)
+      op[i] = ref[i];
+    op += matchLen;
+  }
+  return size_t(op - out);
+}
+
+} // namespace blockz
+} // namespace logvisor
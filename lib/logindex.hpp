@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* Sidecar index shared by file loggers and logvisor-query.
+ *
+ * "<path>.idx" sits next to an uncompressed text or JSON log and holds a Header
+ * followed by fixed-size Entries in file order. Each entry summarizes a run of
+ * whole records: the byte range they occupy in the log, their uptime and frame
+ * ranges, which severities occur and a 64-bit mask of module name hashes. A reader
+ * seeks straight to the runs that can match a query and scans only those. Bytes
+ * not covered by any entry (the run still being filled when the process stopped,
+ * or text appended without an index) are treated as matching everything. */
+
+namespace logvisor {
+namespace logindex {
+
+static constexpr char Magic[8] = {'L', 'V', 'I', 'N', 'D', 'E', 'X', '\0'};
+static constexpr uint32_t Version = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t entrySize; /**< sizeof(Entry) of the writer, so later versions can append fields */
+};
+
+struct Entry {
+  uint64_t offset; /**< Log file offset of the first record */
+  uint64_t length; /**< Bytes up to the end of the last record */
+  uint64_t minUptimeNs;
+  uint64_t maxUptimeNs;
+  uint64_t minFrame;
+  uint64_t maxFrame;
+  uint64_t modules;   /**< ModuleBit() of every module reporting in the run */
+  uint32_t records;
+  uint8_t severities; /**< Bit n set if a record of Level n occurs */
+  uint8_t reserved[3];
+};
+static_assert(sizeof(Entry) == 64, "entries are written as-is");
+
+/* FNV-1a of the module name, folded to one of 64 bits */
+inline uint64_t ModuleBit(const char* name, size_t len) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i)
+    hash = (hash ^ uint8_t(name[i])) * 1099511628211ull;
+  return uint64_t(1) << ((hash ^ (hash >> 32)) & 63);
+}
+
+inline uint64_t ModuleBit(const char* name) { return ModuleBit(name, strlen(name)); }
+
+} // namespace logindex
+} // namespace logvisor
@@ -12,27 +12,65 @@
 #elif defined(__SWITCH__)
 #include <cstring>
 #include "nxstl/thread"
+#include "nxstl/condition_variable"
 #else
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <cxxabi.h>
 #include <cstring>
 #if __linux__
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <elf.h>
+#include <link.h>
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#define LOGVISOR_HAS_IO_URING 1
+#endif
 #endif
 #endif
 
 #include <fcntl.h>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <string>
+#include <filesystem>
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <bit>
+#include <type_traits>
 #include <cstdio>
 #include <cinttypes>
+#include <climits>
+#include <cerrno>
+#include <cmath>
+#include <ctime>
 #include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define LOGVISOR_HAS_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define LOGVISOR_HAS_TSC 1
+#endif
 #include "logvisor/logvisor.hpp"
+#include "binlog.hpp"
+#include "seglog.hpp"
+#include "shmring.hpp"
+#include "logindex.hpp"
+#include "blockz.hpp"
 
 /* ANSI sequences */
 #define RED "\x1b[1;31m"
@@ -52,15 +90,100 @@ void logvisorBp() {}
 namespace logvisor {
 static Module Log("logvisor");
 
-static std::unordered_map<std::thread::id, const char*> ThreadMap;
+static uint64_t CurrentOSThreadId() {
+#if _WIN32
+  return GetCurrentThreadId();
+#elif __APPLE__
+  uint64_t tid = 0;
+  pthread_threadid_np(nullptr, &tid);
+  return tid;
+#elif __linux__
+  return uint64_t(syscall(SYS_gettid));
+#else
+  return std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
 
-static void AddThreadToMap(const char* name) {
-  auto lk = LockLog();
-  ThreadMap[std::this_thread::get_id()] = name;
+/* Identity of a logging thread, owned by that thread and linked into the live list */
+struct ThreadEntry {
+  ThreadInfo info = {};
+  ThreadEntry* prev = nullptr;
+  ThreadEntry* next = nullptr;
+  ThreadEntry();
+  ~ThreadEntry();
+};
+
+static std::mutex ThreadRegistryMutex;
+static ThreadEntry* LiveThreads = nullptr;
+static std::atomic<uint32_t> NextThreadSeq(1);
+
+/* Names outlive their threads so queued records and flight recorder slots can still
+ * reference them, so they are never freed. The table is capped instead: once it holds
+ * MaxThreadNames distinct names, threads with new names are logged as unnamed. */
+static constexpr size_t MaxThreadNames = 1024;
+static bool ThreadNamesFull = false;
+
+/* Caller holds ThreadRegistryMutex */
+static const char* InternThreadName(const char* name) {
+  static std::unordered_set<std::string>* names = new std::unordered_set<std::string>;
+  if (!name)
+    return nullptr;
+  auto search = names->find(name);
+  if (search != names->end())
+    return search->c_str();
+  if (names->size() >= MaxThreadNames) {
+    ThreadNamesFull = true;
+    return nullptr;
+  }
+  return names->insert(name).first->c_str();
+}
+
+ThreadEntry::ThreadEntry() {
+  info.osId = CurrentOSThreadId();
+  info.seqId = NextThreadSeq.fetch_add(1);
+  std::lock_guard<std::mutex> lk(ThreadRegistryMutex);
+  next = LiveThreads;
+  if (next)
+    next->prev = this;
+  LiveThreads = this;
+}
+
+ThreadEntry::~ThreadEntry() {
+  std::lock_guard<std::mutex> lk(ThreadRegistryMutex);
+  if (prev)
+    prev->next = next;
+  else
+    LiveThreads = next;
+  if (next)
+    next->prev = prev;
+}
+
+/* Constructed on the thread's first registration or report */
+static thread_local ThreadEntry CurrentThread;
+
+std::vector<ThreadInfo> GetLiveThreads() {
+  std::vector<ThreadInfo> ret;
+  std::lock_guard<std::mutex> lk(ThreadRegistryMutex);
+  for (ThreadEntry* entry = LiveThreads; entry; entry = entry->next)
+    ret.push_back(entry->info);
+  return ret;
 }
 
 void RegisterThreadName(const char* name) {
-  AddThreadToMap(name);
+  bool warnFull = false;
+  {
+    ThreadEntry& entry = CurrentThread;
+    std::lock_guard<std::mutex> lk(ThreadRegistryMutex);
+    entry.info.name = InternThreadName(name);
+    warnFull = std::exchange(ThreadNamesFull, false);
+  }
+  if (!name)
+    return;
+  if (warnFull) {
+    static std::atomic_bool warned(false);
+    if (!warned.exchange(true))
+      Log.report(Warning, "more than %u distinct thread names; new names are not logged", unsigned(MaxThreadNames));
+  }
 #if __APPLE__
   pthread_setname_np(name);
 #elif __linux__
@@ -78,6 +201,9 @@ void RegisterThreadName(const char* name) {
 #endif
 }
 
+static void CrashDumpFlightRecorder();
+static void CrashWriteBacktrace(int fd, unsigned skipFrames);
+
 #if _WIN32
 #pragma comment(lib, "Dbghelp.lib")
 
@@ -115,6 +241,7 @@ void KillProcessTree() {
 }
 
 void logvisorAbort() {
+  CrashDumpFlightRecorder();
 #if !WINDOWS_STORE
   unsigned int i;
   void* stack[100];
@@ -165,41 +292,35 @@ void logvisorAbort() {
 }
 
 #elif defined(__SWITCH__)
-void logvisorAbort() { exit(1); }
+void logvisorAbort() {
+  CrashDumpFlightRecorder();
+  exit(1);
+}
 #else
 
 void KillProcessTree() {}
 
 #include <execinfo.h>
 void logvisorAbort() {
+  CrashDumpFlightRecorder();
+#if __linux__
+  /* Resolved from the prepared symbol index and written without allocating */
+  fflush(stderr);
+  CrashWriteBacktrace(2, 1);
+#else
   void* array[128];
   size_t size = backtrace(array, 128);
 
-  constexpr size_t exeBufSize = 1024 + 1;
-  char exeNameBuffer[exeBufSize] = {};
-
-#if __linux__
-  readlink("/proc/self/exe", exeNameBuffer, exeBufSize);
-#endif
-
   char cmdLine[1024];
 #if __APPLE__
   snprintf(cmdLine, 1024, "atos -p %d", getpid());
 #else
-  snprintf(cmdLine, 1024, "2>/dev/null addr2line -C -f -e \"%s\"", exeNameBuffer);
+  snprintf(cmdLine, 1024, "2>/dev/null addr2line -C -f -e \"\"");
 #endif
 
   std::string cmdLineStr = cmdLine;
   for (size_t i = 0; i < size; i++) {
-#if __linux__
-    Dl_info dlip;
-    if (dladdr(array[i], &dlip))
-      snprintf(cmdLine, 128, " %p", (void*)((uint8_t*)array[i] - (uint8_t*)dlip.dli_fbase));
-    else
-      snprintf(cmdLine, 128, " %p", array[i]);
-#else
     snprintf(cmdLine, 128, " %p", array[i]);
-#endif
     cmdLineStr += cmdLine;
   }
 
@@ -225,6 +346,7 @@ void logvisorAbort() {
       }
     }
   }
+#endif
 
   fflush(stderr);
   fflush(stdout);
@@ -240,373 +362,5148 @@ void logvisorAbort() {
 
 #endif
 
-LogMutex _LogMutex;
+/* Symbolizer. On Linux each loaded ELF object's symbol table is read once into a
+ * sorted index; snapshots of the object list are published atomically, so
+ * lookups take no locks and allocate nothing once the index is built. */
+#if __linux__
+struct SymbolEntry {
+  uintptr_t addr;
+  uintptr_t size;
+  const char* name;
+};
 
-static void AbortHandler(int signum) {
-  _LogMutex.enabled = false;
-  switch (signum) {
-  case SIGSEGV:
-    Log.report(logvisor::Fatal, "Segmentation Fault");
-  case SIGILL:
-    Log.report(logvisor::Fatal, "Bad Execution");
-  case SIGFPE:
-    Log.report(logvisor::Fatal, "Floating Point Exception");
-  case SIGABRT:
-    Log.report(logvisor::Fatal, "Abort Signal");
-  default:
-    Log.report(logvisor::Fatal, "unknown signal %d", signum);
+struct SymbolObject {
+  std::string path;
+  uintptr_t bias = 0;
+  std::vector<std::pair<uintptr_t, uintptr_t>> ranges; /**< Loaded [begin, end) address ranges */
+  std::vector<SymbolEntry> symbols;                    /**< Sorted by address; names point into the mapping */
+};
+
+struct SymbolIndex {
+  std::vector<const SymbolObject*> objects;
+};
+
+/* Snapshots are retired through the logger list's hazard pointers */
+static LoggerList::Hazard* AcquireHazard();
+static LoggerList::Hazard* EnterHazard();
+static void LeaveHazard(LoggerList::Hazard* rec);
+static void SetHazard(LoggerList::Hazard* rec, const void* ptr);
+static std::vector<const void*> ProtectedPointers();
+
+static std::mutex SymbolizerMutex;
+static std::atomic<const SymbolIndex*> CurrentSymbolIndex(nullptr);
+/* Outlives static destruction, like the objects it indexes, for reports made during exit */
+static std::vector<const SymbolIndex*>* RetiredSymbolIndexes = new std::vector<const SymbolIndex*>;
+/* Loader counters of dl_phdr_info when the current snapshot was taken */
+static std::atomic<unsigned long long> SymbolIndexAdds(0);
+static std::atomic<unsigned long long> SymbolIndexSubs(0);
+/* Reserved by PrepareSymbolizer for crash paths, which can't allocate one */
+static LoggerList::Hazard* CrashSymbolHazard = nullptr;
+
+/* Cheap check for dlopen/dlclose since the last snapshot; stops at the first object */
+static bool LoadedObjectsChanged() {
+  unsigned long long counts[2] = {};
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t, void* data) -> int {
+        auto counts = static_cast<unsigned long long*>(data);
+        counts[0] = info->dlpi_adds;
+        counts[1] = info->dlpi_subs;
+        return 1;
+      },
+      counts);
+  return counts[0] != SymbolIndexAdds.load(std::memory_order_relaxed) ||
+         counts[1] != SymbolIndexSubs.load(std::memory_order_relaxed);
+}
+
+/* Maps path and collects function symbols; the mapping is kept for the process lifetime */
+static void LoadSymbols(SymbolObject& obj) {
+  int fd = open(obj.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat st;
+  void* map = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ElfW(Ehdr))
+                  ? mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0)
+                  : MAP_FAILED;
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return;
+  const uint8_t* image = (const uint8_t*)map;
+  size_t imageSize = size_t(st.st_size);
+  auto ehdr = (const ElfW(Ehdr)*)image;
+  unsigned nativeClass = sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32;
+  if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) || ehdr->e_ident[EI_CLASS] != nativeClass ||
+      ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+      ehdr->e_shoff + uint64_t(ehdr->e_shnum) * sizeof(ElfW(Shdr)) > imageSize) {
+    munmap(map, imageSize);
+    return;
+  }
+  auto shdrs = (const ElfW(Shdr)*)(image + ehdr->e_shoff);
+
+  /* The full symbol table is a superset of the dynamic one; stripped objects only have the latter */
+  const ElfW(Shdr)* symtab = nullptr;
+  for (unsigned i = 0; i < ehdr->e_shnum; ++i)
+    if (shdrs[i].sh_type == SHT_SYMTAB || (shdrs[i].sh_type == SHT_DYNSYM && !symtab))
+      symtab = &shdrs[i];
+  if (!symtab || symtab->sh_link >= ehdr->e_shnum || symtab->sh_offset + symtab->sh_size > imageSize) {
+    munmap(map, imageSize);
+    return;
+  }
+  const ElfW(Shdr)& strtab = shdrs[symtab->sh_link];
+  if (strtab.sh_offset + strtab.sh_size > imageSize || !strtab.sh_size) {
+    munmap(map, imageSize);
+    return;
   }
+  const char* strings = (const char*)(image + strtab.sh_offset);
+
+  auto syms = (const ElfW(Sym)*)(image + symtab->sh_offset);
+  size_t count = symtab->sh_size / sizeof(ElfW(Sym));
+  for (size_t i = 0; i < count; ++i) {
+    const ElfW(Sym)& sym = syms[i];
+    unsigned type = ELF64_ST_TYPE(sym.st_info);
+    if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF || !sym.st_value ||
+        sym.st_name >= strtab.sh_size)
+      continue;
+    obj.symbols.push_back({uintptr_t(sym.st_value), uintptr_t(sym.st_size), strings + sym.st_name});
+  }
+  /* Aliases share an address; keep the sized one */
+  std::sort(obj.symbols.begin(), obj.symbols.end(), [](const SymbolEntry& a, const SymbolEntry& b) {
+    return a.addr != b.addr ? a.addr < b.addr : a.size > b.size;
+  });
+  obj.symbols.erase(std::unique(obj.symbols.begin(), obj.symbols.end(),
+                                [](const SymbolEntry& a, const SymbolEntry& b) { return a.addr == b.addr; }),
+                    obj.symbols.end());
+  obj.symbols.shrink_to_fit();
+  if (obj.symbols.empty())
+    munmap(map, imageSize);
 }
 
-uint64_t _LogCounter;
+/* Publishes a new snapshot that includes any objects loaded since the last one */
+static void RefreshSymbolIndex(bool wait) {
+  std::unique_lock<std::mutex> lk(SymbolizerMutex, std::defer_lock);
+  if (wait)
+    lk.lock();
+  else if (!lk.try_lock())
+    return;
+  /* Objects are never unloaded from the index; stale entries only affect addresses that are already dead */
+  static std::unordered_map<std::string, SymbolObject*>* known = new std::unordered_map<std::string, SymbolObject*>;
+  std::vector<SymbolObject> found;
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t, void* data) -> int {
+        if (static_cast<std::vector<SymbolObject>*>(data)->empty()) {
+          SymbolIndexAdds.store(info->dlpi_adds, std::memory_order_relaxed);
+          SymbolIndexSubs.store(info->dlpi_subs, std::memory_order_relaxed);
+        }
+        SymbolObject obj;
+        obj.path = info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name : "/proc/self/exe";
+        obj.bias = uintptr_t(info->dlpi_addr);
+        for (unsigned i = 0; i < info->dlpi_phnum; ++i)
+          if (info->dlpi_phdr[i].p_type == PT_LOAD)
+            obj.ranges.emplace_back(obj.bias + info->dlpi_phdr[i].p_vaddr,
+                                    obj.bias + info->dlpi_phdr[i].p_vaddr + info->dlpi_phdr[i].p_memsz);
+        if (!obj.ranges.empty())
+          static_cast<std::vector<SymbolObject>*>(data)->push_back(std::move(obj));
+        return 0;
+      },
+      &found);
 
-std::vector<std::unique_ptr<ILogger>> MainLoggers;
-std::atomic_size_t ErrorCount(0);
-static std::chrono::steady_clock MonoClock;
-static std::chrono::steady_clock::time_point GlobalStart = MonoClock.now();
-static inline std::chrono::steady_clock::duration CurrentUptime() { return MonoClock.now() - GlobalStart; }
-std::atomic_uint_fast64_t FrameIndex(0);
+  SymbolIndex* index = new SymbolIndex;
+  for (SymbolObject& obj : found) {
+    std::string key = obj.path + '@' + std::to_string(obj.bias);
+    auto search = known->find(key);
+    if (search == known->end()) {
+      SymbolObject* loaded = new SymbolObject(std::move(obj));
+      LoadSymbols(*loaded);
+      if (loaded->path == "/proc/self/exe") {
+        char exePath[1024];
+        ssize_t len = readlink("/proc/self/exe", exePath, sizeof(exePath) - 1);
+        if (len > 0)
+          loaded->path.assign(exePath, size_t(len));
+      }
+      search = known->emplace(key, loaded).first;
+    }
+    index->objects.push_back(search->second);
+  }
+  /* Earlier snapshots are freed once no concurrent lookup protects them */
+  if (const SymbolIndex* old = CurrentSymbolIndex.exchange(index, std::memory_order_seq_cst))
+    RetiredSymbolIndexes->push_back(old);
+  std::vector<const void*> protectedIndexes = ProtectedPointers();
+  auto split = std::stable_partition(
+      RetiredSymbolIndexes->begin(), RetiredSymbolIndexes->end(), [&](const SymbolIndex* retired) {
+        return std::find(protectedIndexes.begin(), protectedIndexes.end(), retired) != protectedIndexes.end();
+      });
+  for (auto it = split; it != RetiredSymbolIndexes->end(); ++it)
+    delete *it;
+  RetiredSymbolIndexes->erase(split, RetiredSymbolIndexes->end());
+}
 
-static inline int ConsoleWidth() {
-  int retval = 80;
-#if _WIN32
-#if !WINDOWS_STORE
-  CONSOLE_SCREEN_BUFFER_INFO info;
-  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
-  retval = info.dwSize.X - 1;
-#endif
-#elif defined(__SWITCH__)
-  return 80;
+/* Loads the current snapshot under rec's protection */
+static const SymbolIndex* ProtectSymbolIndex(LoggerList::Hazard* rec) {
+  const SymbolIndex* index = CurrentSymbolIndex.load(std::memory_order_acquire);
+  for (;;) {
+    SetHazard(rec, index);
+    const SymbolIndex* again = CurrentSymbolIndex.load(std::memory_order_seq_cst);
+    if (again == index)
+      return index;
+    index = again;
+  }
+}
+
+static const SymbolObject* FindSymbolObject(const SymbolIndex* index, uintptr_t addr) {
+  if (!index)
+    return nullptr;
+  for (const SymbolObject* obj : index->objects)
+    for (const auto& range : obj->ranges)
+      if (addr >= range.first && addr < range.second)
+        return obj;
+  return nullptr;
+}
+
+void PrepareSymbolizer() {
+  RefreshSymbolIndex(true);
+  {
+    std::lock_guard<std::mutex> lk(SymbolizerMutex);
+    if (!CrashSymbolHazard)
+      CrashSymbolHazard = AcquireHazard();
+  }
+  /* The first backtrace() loads the unwinder, which must not happen on a crash path */
+  void* frame;
+  backtrace(&frame, 1);
+}
+
+static void FindSymbol(const SymbolObject* obj, uintptr_t addr, SymbolInfo& info) {
+  info.object = obj->path.c_str();
+  info.symbol = nullptr;
+  info.offset = addr - obj->bias;
+  uintptr_t rel = addr - obj->bias;
+  auto it = std::upper_bound(obj->symbols.begin(), obj->symbols.end(), rel,
+                             [](uintptr_t value, const SymbolEntry& entry) { return value < entry.addr; });
+  if (it != obj->symbols.begin()) {
+    --it;
+    if (!it->size || rel < it->addr + it->size) {
+      info.symbol = it->name;
+      info.offset = rel - it->addr;
+    }
+  }
+}
+
+/* Async-signal-safe: consults the published index only and never refreshes it */
+static bool CrashSymbolize(const void* address, SymbolInfo& info) {
+  if (!CrashSymbolHazard)
+    return false;
+  uintptr_t addr = uintptr_t(address);
+  const SymbolObject* obj = FindSymbolObject(ProtectSymbolIndex(CrashSymbolHazard), addr);
+  if (!obj)
+    return false;
+  FindSymbol(obj, addr, info);
+  return true;
+}
+
+bool Symbolize(const void* address, SymbolInfo& info) {
+  uintptr_t addr = uintptr_t(address);
+  LoggerList::Hazard* hazard = EnterHazard();
+  const SymbolIndex* index = ProtectSymbolIndex(hazard);
+  const SymbolObject* obj = FindSymbolObject(index, addr);
+  if (!obj) {
+    /* Index not built yet, or an object was loaded or unloaded since. Later refreshes
+     * don't wait, so a crash inside the symbolizer can't deadlock on its own lock. */
+    Dl_info dlip;
+    if (!index || (dladdr(address, &dlip) && LoadedObjectsChanged())) {
+      RefreshSymbolIndex(!index);
+      obj = FindSymbolObject(ProtectSymbolIndex(hazard), addr);
+    }
+  }
+  if (obj)
+    FindSymbol(obj, addr, info);
+  LeaveHazard(hazard);
+  return obj != nullptr;
+}
+#elif !_WIN32 && !defined(__SWITCH__)
+void PrepareSymbolizer() {}
+
+bool Symbolize(const void* address, SymbolInfo& info) {
+  Dl_info dlip;
+  if (!dladdr(address, &dlip))
+    return false;
+  info.object = dlip.dli_fname;
+  info.symbol = dlip.dli_sname;
+  info.offset = uintptr_t(address) - uintptr_t(dlip.dli_sname ? dlip.dli_saddr : dlip.dli_fbase);
+  return true;
+}
+
+static bool CrashSymbolize(const void* address, SymbolInfo& info) { return Symbolize(address, info); }
 #else
-  struct winsize w;
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != -1)
-    retval = w.ws_col;
+void PrepareSymbolizer() {}
+
+bool Symbolize(const void* address, SymbolInfo& info) { return false; }
 #endif
-  if (retval < 10)
-    return 10;
-  return retval;
-}
 
+std::string FormatBacktrace(unsigned skipFrames, unsigned maxFrames) {
+  std::vector<void*> frames(size_t(maxFrames) + skipFrames + 1);
 #if _WIN32
-static HANDLE Term = 0;
+  size_t count = CaptureStackBackTrace(0, DWORD(frames.size()), frames.data(), nullptr);
+#elif defined(__SWITCH__)
+  size_t count = 0;
 #else
-static const char* Term = nullptr;
+  size_t count = size_t(backtrace(frames.data(), int(frames.size())));
 #endif
-bool XtermColor = false;
-struct ConsoleLogger : public ILogger {
-  ConsoleLogger() {
+  std::string ret;
+  char line[128];
+  for (size_t i = skipFrames + 1; i < count; ++i) {
+    snprintf(line, sizeof(line), "#%zu %p", i - skipFrames - 1, frames[i]);
+    ret += line;
+    SymbolInfo info;
+    if (Symbolize(frames[i], info)) {
+      if (info.symbol) {
+        ret += ' ';
 #if _WIN32
-#if !WINDOWS_STORE
-    const char* conemuANSI = getenv("ConEmuANSI");
-    if (conemuANSI && !strcmp(conemuANSI, "ON"))
-      XtermColor = true;
-#endif
-    if (!Term)
-      Term = GetStdHandle(STD_ERROR_HANDLE);
+        ret += info.symbol;
 #else
-    if (!Term) {
-      Term = getenv("TERM");
-      if (Term && !strncmp(Term, "xterm", 5)) {
-        XtermColor = true;
-        putenv((char*)"TERM=xterm-16color");
+        int status;
+        char* demangledName = abi::__cxa_demangle(info.symbol, nullptr, nullptr, &status);
+        ret += demangledName ? demangledName : info.symbol;
+        free(demangledName);
+#endif
+      }
+      snprintf(line, sizeof(line), "+0x%zx", size_t(info.offset));
+      if (info.symbol)
+        ret += line;
+      if (info.object) {
+        ret += " (";
+        ret += info.object;
+        if (!info.symbol)
+          ret += line;
+        ret += ')';
       }
     }
-#endif
+    ret += '\n';
   }
+  return ret;
+}
 
-  static void _reportHead(const char* modName, const char* sourceInfo, Level severity) {
-    /* Clear current line out */
-    int width = ConsoleWidth();
-    fprintf(stderr, "\r");
-    for (int w = 0; w < width; ++w)
-      fprintf(stderr, " ");
-    fprintf(stderr, "\r");
-
-    std::chrono::steady_clock::duration tm = CurrentUptime();
-    double tmd = tm.count() * std::chrono::steady_clock::duration::period::num /
-                 (double)std::chrono::steady_clock::duration::period::den;
-    std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    if (ThreadMap.find(thrId) != ThreadMap.end())
-      thrName = ThreadMap[thrId];
-
-    if (XtermColor) {
-      fprintf(stderr, BOLD "[");
-      fprintf(stderr, GREEN "%5.4f ", tmd);
-      uint_fast64_t fIdx = FrameIndex.load();
-      if (fIdx)
-        fprintf(stderr, "(%" PRIu64 ") ", fIdx);
-      switch (severity) {
-      case Info:
-        fprintf(stderr, BOLD CYAN "INFO");
-        break;
-      case Warning:
-        fprintf(stderr, BOLD YELLOW "WARNING");
-        break;
-      case Error:
-        fprintf(stderr, RED BOLD "ERROR");
-        break;
-      case Fatal:
-        fprintf(stderr, BOLD RED "FATAL ERROR");
-        break;
-      default:
-        break;
-      };
-      fprintf(stderr, NORMAL BOLD " %s", modName);
-      if (sourceInfo)
-        fprintf(stderr, BOLD YELLOW " {%s}", sourceInfo);
-      if (thrName)
-        fprintf(stderr, BOLD MAGENTA " (%s)", thrName);
-      fprintf(stderr, NORMAL BOLD "] " NORMAL);
-    } else {
-#if _WIN32
-#if !WINDOWS_STORE
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      fprintf(stderr, "[");
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN);
-      fprintf(stderr, "%5.4f ", tmd);
-      uint64_t fi = FrameIndex.load();
-      if (fi)
-        fprintf(stderr, "(%" PRIu64 ") ", fi);
-      switch (severity) {
-      case Info:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE);
-        fprintf(stderr, "INFO");
-        break;
-      case Warning:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
-        fprintf(stderr, "WARNING");
-        break;
-      case Error:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
-        fprintf(stderr, "ERROR");
-        break;
-      case Fatal:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
-        fprintf(stderr, "FATAL ERROR");
-        break;
-      default:
-        break;
-      };
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      fprintf(stderr, " %s", modName);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
-      if (sourceInfo)
-        fprintf(stderr, " {%s}", sourceInfo);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE);
-      if (thrName)
-        fprintf(stderr, " (%s)", thrName);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      fprintf(stderr, "] ");
-      SetConsoleTextAttribute(Term, FOREGROUND_WHITE);
-#endif
-#else
-      fprintf(stderr, "[");
-      fprintf(stderr, "%5.4f ", tmd);
-      uint_fast64_t fIdx = FrameIndex.load();
-      if (fIdx)
-        fprintf(stderr, "(%" PRIu64 ") ", fIdx);
-      switch (severity) {
-      case Info:
-        fprintf(stderr, "INFO");
-        break;
-      case Warning:
-        fprintf(stderr, "WARNING");
-        break;
-      case Error:
-        fprintf(stderr, "ERROR");
-        break;
-      case Fatal:
-        fprintf(stderr, "FATAL ERROR");
-        break;
-      default:
-        break;
-      };
-      fprintf(stderr, " %s", modName);
-      if (sourceInfo)
-        fprintf(stderr, " {%s}", sourceInfo);
-      if (thrName)
-        fprintf(stderr, " (%s)", thrName);
-      fprintf(stderr, "] ");
-#endif
-    }
-  }
+LogMutex _LogMutex;
 
-  void report(const char* modName, Level severity, const char* format, va_list ap) {
-    _reportHead(modName, nullptr, severity);
-    vfprintf(stderr, format, ap);
-    fprintf(stderr, "\n");
-    fflush(stderr);
-  }
+std::atomic<uint64_t> _LogCounter(0);
 
-  void report(const char* modName, Level severity, const wchar_t* format, va_list ap) {
-    _reportHead(modName, nullptr, severity);
-    vfwprintf(stderr, format, ap);
-    fprintf(stderr, "\n");
-    fflush(stderr);
-  }
+/* Logger registration. Each change publishes a new immutable Set; readers protect the
+ * set they iterate with a hazard pointer, and a replaced set is freed, together with any
+ * loggers only it still owned, once no hazard pointer refers to it. */
+struct LoggerList::Set {
+  std::vector<ILogger*> loggers;
+  std::vector<std::shared_ptr<ILogger>> owners;
+};
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
-                    va_list ap) {
-    char sourceInfo[128];
-    snprintf(sourceInfo, 128, "%s:%u", file, linenum);
-    _reportHead(modName, sourceInfo, severity);
-    vfprintf(stderr, format, ap);
-    fprintf(stderr, "\n");
-    fflush(stderr);
+/* One per thread per nesting level of snapshots. Records are never freed, only
+ * released for reuse by other threads when their thread exits. */
+struct LoggerList::Hazard {
+  std::atomic<const void*> ptr{nullptr};
+  std::atomic<bool> active{true};
+  Hazard* next = nullptr;
+};
+static std::atomic<LoggerList::Hazard*> HazardRecords(nullptr);
+
+static LoggerList::Hazard* AcquireHazard() {
+  for (LoggerList::Hazard* rec = HazardRecords.load(std::memory_order_acquire); rec; rec = rec->next) {
+    bool idle = false;
+    if (!rec->active.load(std::memory_order_relaxed) && rec->active.compare_exchange_strong(idle, true))
+      return rec;
   }
+  LoggerList::Hazard* rec = new LoggerList::Hazard;
+  LoggerList::Hazard* head = HazardRecords.load(std::memory_order_relaxed);
+  do
+    rec->next = head;
+  while (!HazardRecords.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+  return rec;
+}
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
-                    va_list ap) {
-    char sourceInfo[128];
-    snprintf(sourceInfo, 128, "%s:%u", file, linenum);
-    _reportHead(modName, sourceInfo, severity);
-    vfwprintf(stderr, format, ap);
-    fprintf(stderr, "\n");
-    fflush(stderr);
+static void ReleaseHazard(LoggerList::Hazard* rec) {
+  rec->ptr.store(nullptr, std::memory_order_release);
+  rec->active.store(false, std::memory_order_release);
+}
+
+struct ThreadHazards {
+  static constexpr size_t MaxDepth = 8;
+  LoggerList::Hazard* levels[MaxDepth] = {};
+  size_t depth = 0;
+  bool exited = false;
+  ~ThreadHazards() {
+    for (LoggerList::Hazard* rec : levels)
+      if (rec)
+        ReleaseHazard(rec);
+    exited = true;
   }
 };
+static thread_local ThreadHazards CurrentHazards;
 
-void RegisterConsoleLogger() {
-  /* Otherwise construct new console logger */
-  MainLoggers.emplace_back(new ConsoleLogger);
+/* Hazard record for the calling thread's current nesting level; pair with LeaveHazard() */
+static LoggerList::Hazard* EnterHazard() {
+  ThreadHazards& hazards = CurrentHazards;
+  LoggerList::Hazard* rec;
+  /* Deep nesting and reports made during thread exit use a record of their own */
+  if (hazards.exited || hazards.depth >= ThreadHazards::MaxDepth) {
+    rec = AcquireHazard();
+  } else {
+    LoggerList::Hazard*& level = hazards.levels[hazards.depth];
+    if (!level)
+      level = AcquireHazard();
+    rec = level;
+  }
+  ++hazards.depth;
+  return rec;
 }
 
-#if _WIN32
-void CreateWin32Console() {
-#if !WINDOWS_STORE
-  /* Debug console */
-  AllocConsole();
-
-  freopen("CONIN$", "r", stdin);
-  freopen("CONOUT$", "w", stdout);
-  freopen("CONOUT$", "w", stderr);
-#endif
+static void LeaveHazard(LoggerList::Hazard* rec) {
+  ThreadHazards& hazards = CurrentHazards;
+  --hazards.depth;
+  if (!hazards.exited && hazards.depth < ThreadHazards::MaxDepth && hazards.levels[hazards.depth] == rec)
+    rec->ptr.store(nullptr, std::memory_order_release);
+  else
+    ReleaseHazard(rec);
 }
-#endif
 
-void RegisterStandardExceptions() {
-  signal(SIGABRT, AbortHandler);
-  signal(SIGSEGV, AbortHandler);
-  signal(SIGILL, AbortHandler);
-  signal(SIGFPE, AbortHandler);
+static void SetHazard(LoggerList::Hazard* rec, const void* ptr) { rec->ptr.store(ptr, std::memory_order_seq_cst); }
+
+/* Everything some thread currently protects; retired objects outside this list may be freed */
+static std::vector<const void*> ProtectedPointers() {
+  std::vector<const void*> ptrs;
+  for (LoggerList::Hazard* rec = HazardRecords.load(std::memory_order_acquire); rec; rec = rec->next)
+    if (const void* ptr = rec->ptr.load(std::memory_order_seq_cst))
+      ptrs.push_back(ptr);
+  return ptrs;
 }
 
-struct FileLogger : public ILogger {
-  FILE* fp;
-  virtual void openFile() = 0;
-  virtual void closeFile() { fclose(fp); }
-
-  void _reportHead(const char* modName, const char* sourceInfo, Level severity) {
-    std::chrono::steady_clock::duration tm = CurrentUptime();
-    double tmd = tm.count() * std::chrono::steady_clock::duration::period::num /
-                 (double)std::chrono::steady_clock::duration::period::den;
-    std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    if (ThreadMap.find(thrId) != ThreadMap.end())
-      thrName = ThreadMap[thrId];
-
-    fprintf(fp, "[");
-    fprintf(fp, "%5.4f ", tmd);
-    uint_fast64_t fIdx = FrameIndex.load();
-    if (fIdx)
-      fprintf(fp, "(%" PRIu64 ") ", fIdx);
-    switch (severity) {
-    case Info:
-      fprintf(fp, "INFO");
-      break;
-    case Warning:
-      fprintf(fp, "WARNING");
-      break;
-    case Error:
-      fprintf(fp, "ERROR");
+LoggerList::Snapshot::Snapshot(const LoggerList& list) {
+  m_hazard = EnterHazard();
+  const Set* set = list.m_current.load(std::memory_order_acquire);
+  for (;;) {
+    SetHazard(m_hazard, set);
+    const Set* again = list.m_current.load(std::memory_order_seq_cst);
+    if (again == set)
       break;
-    case Fatal:
-      fprintf(fp, "FATAL ERROR");
-      break;
-    default:
-      break;
-    };
-    fprintf(fp, " %s", modName);
-    if (sourceInfo)
-      fprintf(fp, " {%s}", sourceInfo);
-    if (thrName)
-      fprintf(fp, " (%s)", thrName);
-    fprintf(fp, "] ");
+    set = again;
   }
+  m_set = set;
+}
 
-  void report(const char* modName, Level severity, const char* format, va_list ap) {
-    openFile();
-    _reportHead(modName, nullptr, severity);
-    vfprintf(fp, format, ap);
-    fprintf(fp, "\n");
-    closeFile();
-  }
+LoggerList::Snapshot::~Snapshot() { LeaveHazard(m_hazard); }
 
-  void report(const char* modName, Level severity, const wchar_t* format, va_list ap) {
-    openFile();
-    _reportHead(modName, nullptr, severity);
-    vfwprintf(fp, format, ap);
-    fprintf(fp, "\n");
-    closeFile();
-  }
+ILogger* const* LoggerList::Snapshot::begin() const { return m_set ? m_set->loggers.data() : nullptr; }
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
-                    va_list ap) {
-    openFile();
-    char sourceInfo[128];
-    snprintf(sourceInfo, 128, "%s:%u", file, linenum);
-    _reportHead(modName, sourceInfo, severity);
-    vfprintf(fp, format, ap);
-    fprintf(fp, "\n");
-    closeFile();
-  }
+ILogger* const* LoggerList::Snapshot::end() const {
+  return m_set ? m_set->loggers.data() + m_set->loggers.size() : nullptr;
+}
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
-                    va_list ap) {
-    openFile();
-    char sourceInfo[128];
-    snprintf(sourceInfo, 128, "%s:%u", file, linenum);
-    _reportHead(modName, sourceInfo, severity);
-    vfwprintf(fp, format, ap);
-    fprintf(fp, "\n");
-    closeFile();
-  }
-};
+/* Caller holds m_writeMutex; replaced sets that are no longer protected are freed after it is released */
+void LoggerList::publish(Set* set) {
+  const Set* old = m_current.exchange(set, std::memory_order_seq_cst);
+  m_count.store(set ? set->loggers.size() : 0, std::memory_order_relaxed);
+  if (old)
+    m_retired.push_back(old);
+}
 
-struct FileLogger8 : public FileLogger {
-  const char* m_filepath;
-  FileLogger8(const char* filepath) : m_filepath(filepath) {}
-  void openFile() { fp = fopen(m_filepath, "a"); }
-};
+static std::vector<const LoggerList::Set*> ReclaimSets(std::vector<const LoggerList::Set*>& retired) {
+  std::vector<const void*> protectedSets = ProtectedPointers();
+  auto isProtected = [&](const LoggerList::Set* set) {
+    return std::find(protectedSets.begin(), protectedSets.end(), set) != protectedSets.end();
+  };
+  auto split = std::stable_partition(retired.begin(), retired.end(), isProtected);
+  std::vector<const LoggerList::Set*> freed(split, retired.end());
+  retired.erase(split, retired.end());
+  return freed;
+}
 
-void RegisterFileLogger(const char* filepath) {
-  /* Otherwise construct new file logger */
-  MainLoggers.emplace_back(new FileLogger8(filepath));
+static void FreeSets(const std::vector<const LoggerList::Set*>& sets) {
+  /* Outside the write lock: destroying a logger may report or register another */
+  for (const LoggerList::Set* set : sets)
+    delete set;
 }
 
-#if LOG_UCS2
+LoggerList::~LoggerList() {
+  for (const Set* set : m_retired)
+    delete set;
+  delete m_current.load();
+}
 
-struct FileLogger16 : public FileLogger {
-  const wchar_t* m_filepath;
-  FileLogger16(const wchar_t* filepath) : m_filepath(filepath) {}
-  void openFile() { fp = _wfopen(m_filepath, L"a"); }
-};
+void LoggerList::emplace_back(ILogger* logger) {
+  std::vector<const Set*> freed;
+  {
+    std::lock_guard<std::mutex> lk(m_writeMutex);
+    const Set* cur = m_current.load(std::memory_order_relaxed);
+    Set* set = cur ? new Set(*cur) : new Set;
+    set->loggers.push_back(logger);
+    set->owners.emplace_back(logger);
+    publish(set);
+    freed = ReclaimSets(m_retired);
+  }
+  FreeSets(freed);
+}
 
-void RegisterFileLogger(const wchar_t* filepath) {
-  /* Determine if file logger already added */
-  for (auto& logger : MainLoggers) {
-    FileLogger16* filelogger = dynamic_cast<FileLogger16*>(logger.get());
-    if (filelogger) {
-      if (!wcscmp(filepath, filelogger->m_filepath))
-        return;
-    }
+bool LoggerList::remove(ILogger* logger) {
+  std::vector<const Set*> freed;
+  {
+    std::lock_guard<std::mutex> lk(m_writeMutex);
+    const Set* cur = m_current.load(std::memory_order_relaxed);
+    if (!cur)
+      return false;
+    auto it = std::find(cur->loggers.begin(), cur->loggers.end(), logger);
+    if (it == cur->loggers.end())
+      return false;
+    size_t index = size_t(it - cur->loggers.begin());
+    Set* set = new Set(*cur);
+    set->loggers.erase(set->loggers.begin() + index);
+    set->owners.erase(set->owners.begin() + index);
+    publish(set);
+    freed = ReclaimSets(m_retired);
   }
+  FreeSets(freed);
+  return true;
+}
 
-  /* Otherwise construct new file logger */
-  MainLoggers.emplace_back(new FileLogger16(filepath));
+void LoggerList::clear() {
+  std::vector<const Set*> freed;
+  {
+    std::lock_guard<std::mutex> lk(m_writeMutex);
+    publish(nullptr);
+    freed = ReclaimSets(m_retired);
+  }
+  FreeSets(freed);
+}
+
+LoggerList MainLoggers;
+std::atomic_size_t ErrorCount(0);
+/* Clocks. Every source yields nanoseconds on the steady clock's timeline, so sources
+ * can be switched at runtime; wall-clock time adds an offset resampled once a second. */
+static std::chrono::steady_clock MonoClock;
+static std::chrono::steady_clock::time_point GlobalStart = MonoClock.now();
+static std::atomic<ClockSource> ActiveClock(ClockSource::Steady);
+
+static inline uint64_t SteadyUptimeNs() {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(MonoClock.now() - GlobalStart).count());
 }
 
+#if __linux__
+/* steady_clock reads CLOCK_MONOTONIC, so the coarse clock shares its epoch */
+static const int64_t GlobalStartNs =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(GlobalStart.time_since_epoch()).count();
+
+static inline uint64_t CoarseUptimeNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  int64_t ns = int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec - GlobalStartNs;
+  return ns > 0 ? uint64_t(ns) : 0;
+}
 #endif
 
+#if LOGVISOR_HAS_TSC
+static uint64_t TscBase = 0;
+static uint64_t TscBaseNs = 0;
+static double TscNsPerTick = 0.0;
+
+static inline uint64_t TscUptimeNs() { return TscBaseNs + uint64_t(double(__rdtsc() - TscBase) * TscNsPerTick); }
+
+/* Only an invariant TSC ticks at a constant rate across power states and cores */
+static bool MeasureTsc() {
+#if _MSC_VER
+  int regs[4];
+  __cpuid(regs, 0x80000000);
+  if (unsigned(regs[0]) < 0x80000007)
+    return false;
+  __cpuid(regs, 0x80000007);
+  if (!(regs[3] & (1 << 8)))
+    return false;
+#else
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+    return false;
+#endif
+  uint64_t startNs = SteadyUptimeNs();
+  uint64_t startTsc = __rdtsc();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t endNs = SteadyUptimeNs();
+  uint64_t endTsc = __rdtsc();
+  if (endTsc <= startTsc)
+    return false;
+  TscNsPerTick = double(endNs - startNs) / double(endTsc - startTsc);
+  TscBase = endTsc;
+  TscBaseNs = endNs;
+  return true;
+}
+
+/* Measured once, before TSC is first published through ActiveClock, and never rewritten:
+ * reporters that loaded ClockSource::TSC may still be reading the calibration */
+static bool CalibrateTsc() {
+  static const bool usable = MeasureTsc();
+  return usable;
+}
+#endif
+
+static inline uint64_t CurrentUptimeNs() {
+  switch (ActiveClock.load(std::memory_order_acquire)) {
+#if __linux__
+  case ClockSource::MonotonicCoarse:
+    return CoarseUptimeNs();
+#endif
+#if LOGVISOR_HAS_TSC
+  case ClockSource::TSC:
+    return TscUptimeNs();
+#endif
+  default:
+    return SteadyUptimeNs();
+  }
+}
+
+ClockSource SetClockSource(ClockSource source) {
+  /* Not the log lock: calibration sleeps, and reports keep flowing on the steady clock meanwhile */
+  static std::mutex SetterMutex;
+  std::lock_guard<std::mutex> lk(SetterMutex);
+  /* Readers see the steady clock while a new source is being set up */
+  ActiveClock.store(ClockSource::Steady, std::memory_order_release);
+#if __linux__
+  if (source == ClockSource::MonotonicCoarse) {
+    ActiveClock.store(source, std::memory_order_release);
+    return source;
+  }
+#endif
+#if LOGVISOR_HAS_TSC
+  if (source == ClockSource::TSC && CalibrateTsc()) {
+    ActiveClock.store(source, std::memory_order_release);
+    return source;
+  }
+#endif
+  return ClockSource::Steady;
+}
+
+static std::atomic<int64_t> WallOffsetNs(0);
+static std::atomic<uint64_t> WallResyncNs(0);
+
+static inline int64_t WallClockNs(uint64_t uptimeNs) {
+  if (uptimeNs >= WallResyncNs.load(std::memory_order_relaxed)) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+    WallOffsetNs.store(now - int64_t(uptimeNs), std::memory_order_relaxed);
+    WallResyncNs.store(uptimeNs + 1000000000, std::memory_order_relaxed);
+  }
+  return int64_t(uptimeNs) + WallOffsetNs.load(std::memory_order_relaxed);
+}
+
+static std::atomic<TimestampStyle> ActiveTimestampStyle(TimestampStyle::Uptime);
+
+void SetTimestampStyle(TimestampStyle style) { ActiveTimestampStyle.store(style, std::memory_order_relaxed); }
+
+std::atomic_uint_fast64_t FrameIndex(0);
+
+/* Header fields of a log record, captured when the report is made */
+struct RecordHead {
+  uint64_t uptimeNs;
+  int64_t wallNs; /**< Nanoseconds since the Unix epoch */
+  uint_fast64_t frameIndex;
+  ThreadInfo thread;
+};
+
+/* Set by the async writer while it replays a queued record */
+static thread_local const RecordHead* ReplayHead = nullptr;
+
+static inline RecordHead CaptureHead() {
+  if (ReplayHead)
+    return *ReplayHead;
+  uint64_t uptimeNs = CurrentUptimeNs();
+  return {uptimeNs, WallClockNs(uptimeNs), FrameIndex.load(), CurrentThread.info};
+}
+
+static inline int QueryConsoleWidth() {
+  int retval = 80;
+#if _WIN32
+#if !WINDOWS_STORE
+  CONSOLE_SCREEN_BUFFER_INFO info;
+  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
+  retval = info.dwSize.X - 1;
+#endif
+#elif defined(__SWITCH__)
+  return 80;
+#else
+  struct winsize w;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != -1)
+    retval = w.ws_col;
+#endif
+  if (retval < 10)
+    return 10;
+  return retval;
+}
+
+/* Refreshed from SIGWINCH where available; zero until first queried */
+static std::atomic_int CachedConsoleWidth(0);
+
+#if !_WIN32 && !defined(__SWITCH__)
+static struct sigaction PrevWinchAction;
+static void WinchHandler(int signum) {
+  CachedConsoleWidth.store(QueryConsoleWidth(), std::memory_order_relaxed);
+  if (!(PrevWinchAction.sa_flags & SA_SIGINFO) && PrevWinchAction.sa_handler != SIG_DFL &&
+      PrevWinchAction.sa_handler != SIG_IGN)
+    PrevWinchAction.sa_handler(signum);
+}
+#endif
+
+static inline int ConsoleWidth() {
+#if _WIN32
+  return QueryConsoleWidth();
+#else
+  int width = CachedConsoleWidth.load(std::memory_order_relaxed);
+  if (!width) {
+    width = QueryConsoleWidth();
+    CachedConsoleWidth.store(width, std::memory_order_relaxed);
+  }
+  return width;
+#endif
+}
+
+/* Wide to UTF-8 transcoding. Log text is overwhelmingly ASCII, so the vector kernels test a
+ * block of units at once and narrow the whole block with saturating packs when every unit is
+ * below 0x80; a block holding anything else is encoded a character at a time. Unpaired
+ * surrogates become U+FFFD, so the output is always valid UTF-8. */
+static constexpr size_t WideBlock = 32;
+
+/* Encodes units [i, end); a surrogate pair straddling end carries i one past it */
+static inline size_t EncodeWideRun(char* out, const wchar_t* str, size_t len, size_t& i, size_t end) {
+  size_t outLen = 0;
+  while (i < end) {
+    uint32_t cp = uint32_t(str[i++]);
+    if (cp < 0x80) {
+      out[outLen++] = char(cp);
+      continue;
+    }
+    if (cp >= 0xD800 && cp < 0xE000) {
+      uint32_t lo = sizeof(wchar_t) == 2 && cp < 0xDC00 && i < len ? uint32_t(str[i]) : 0;
+      if (lo >= 0xDC00 && lo < 0xE000) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+        ++i;
+      } else {
+        cp = 0xFFFD;
+      }
+    }
+    outLen += binlog::EncodeUTF8(out + outLen, cp);
+  }
+  return outLen;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static size_t WideToUTF8Sse2(char* out, const wchar_t* str, size_t len) {
+  size_t i = 0;
+  size_t outLen = 0;
+  while (i < len) {
+    if (len - i >= WideBlock) {
+      const __m128i* in = (const __m128i*)(str + i);
+      __m128i narrow[2];
+      bool ascii;
+      if constexpr (sizeof(wchar_t) == 4) {
+        __m128i v[8];
+        for (int j = 0; j < 8; ++j)
+          v[j] = _mm_loadu_si128(in + j);
+        __m128i any = _mm_or_si128(_mm_or_si128(_mm_or_si128(v[0], v[1]), _mm_or_si128(v[2], v[3])),
+                                   _mm_or_si128(_mm_or_si128(v[4], v[5]), _mm_or_si128(v[6], v[7])));
+        any = _mm_and_si128(any, _mm_set1_epi32(~0x7F));
+        ascii = _mm_movemask_epi8(_mm_cmpeq_epi32(any, _mm_setzero_si128())) == 0xFFFF;
+        narrow[0] = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        narrow[1] = _mm_packus_epi16(_mm_packs_epi32(v[4], v[5]), _mm_packs_epi32(v[6], v[7]));
+      } else {
+        __m128i v[4];
+        for (int j = 0; j < 4; ++j)
+          v[j] = _mm_loadu_si128(in + j);
+        __m128i any = _mm_or_si128(_mm_or_si128(v[0], v[1]), _mm_or_si128(v[2], v[3]));
+        any = _mm_and_si128(any, _mm_set1_epi16(short(0xFF80)));
+        ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(any, _mm_setzero_si128())) == 0xFFFF;
+        narrow[0] = _mm_packus_epi16(v[0], v[1]);
+        narrow[1] = _mm_packus_epi16(v[2], v[3]);
+      }
+      if (ascii) {
+        _mm_storeu_si128((__m128i*)(out + outLen), narrow[0]);
+        _mm_storeu_si128((__m128i*)(out + outLen + 16), narrow[1]);
+        i += WideBlock;
+        outLen += WideBlock;
+        continue;
+      }
+    }
+    outLen += EncodeWideRun(out + outLen, str, len, i, std::min(len, i + WideBlock));
+  }
+  return outLen;
+}
+
+__attribute__((target("avx2"))) static size_t WideToUTF8Avx2(char* out, const wchar_t* str, size_t len) {
+  size_t i = 0;
+  size_t outLen = 0;
+  while (i < len) {
+    if (len - i >= WideBlock) {
+      const __m256i* in = (const __m256i*)(str + i);
+      __m256i narrow;
+      bool ascii;
+      if constexpr (sizeof(wchar_t) == 4) {
+        __m256i a = _mm256_loadu_si256(in);
+        __m256i b = _mm256_loadu_si256(in + 1);
+        __m256i c = _mm256_loadu_si256(in + 2);
+        __m256i d = _mm256_loadu_si256(in + 3);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        ascii = _mm256_testz_si256(any, _mm256_set1_epi32(~0x7F));
+        /* In-lane packs interleave the 4-unit groups; the permute restores their order */
+        narrow = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        narrow = _mm256_permutevar8x32_epi32(narrow, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+      } else {
+        __m256i a = _mm256_loadu_si256(in);
+        __m256i b = _mm256_loadu_si256(in + 1);
+        ascii = _mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16(short(0xFF80)));
+        narrow = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+      }
+      if (ascii) {
+        _mm256_storeu_si256((__m256i*)(out + outLen), narrow);
+        i += WideBlock;
+        outLen += WideBlock;
+        continue;
+      }
+    }
+    outLen += EncodeWideRun(out + outLen, str, len, i, std::min(len, i + WideBlock));
+  }
+  return outLen;
+}
+#endif
+
+/* Writes UTF-8 for len wide characters (UTF-16 or UTF-32) to out, which must hold 4 * len bytes */
+static size_t WideToUTF8(char* out, const wchar_t* str, size_t len) {
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 ? WideToUTF8Avx2(out, str, len) : WideToUTF8Sse2(out, str, len);
+#else
+  size_t i = 0;
+  return EncodeWideRun(out, str, len, i, len);
+#endif
+}
+
+/* Header fragments per output style, so rendering is a sequence of appends */
+struct HeadStyle {
+  std::string_view open;
+  std::string_view severity[4];
+  std::string_view module;
+  std::string_view source;
+  std::string_view sourceClose;
+  std::string_view thread;
+  std::string_view threadClose;
+  std::string_view close;
+};
+
+static constexpr HeadStyle PlainStyle = {
+    "[", {"INFO", "WARNING", "ERROR", "FATAL ERROR"}, " ", " {", "}", " (", ")", "] ",
+};
+
+static constexpr HeadStyle XtermStyle = {
+    BOLD "[" GREEN,
+    {BOLD CYAN "INFO", BOLD YELLOW "WARNING", RED BOLD "ERROR", BOLD RED "FATAL ERROR"},
+    NORMAL BOLD " ",
+    BOLD YELLOW " {",
+    "}",
+    BOLD MAGENTA " (",
+    ")",
+    NORMAL BOLD "] " NORMAL,
+};
+
+static inline void Append(detail::FormatBuffer& out, std::string_view str) { out.append(str.data(), str.size()); }
+
+/* Same text as "%5.4f " of the uptime in seconds, without going through floating point */
+static void AppendUptime(detail::FormatBuffer& out, const RecordHead& head) {
+  uint64_t ticks = (head.uptimeNs + 50000) / 100000;
+  char buf[32];
+  char* end = buf + sizeof(buf);
+  *--end = ' ';
+  uint64_t frac = ticks % 10000;
+  for (int i = 0; i < 4; ++i, frac /= 10)
+    *--end = char('0' + frac % 10);
+  *--end = '.';
+  char* begin = detail::FormatDecimal(end, ticks / 10000);
+  out.append(begin, size_t(buf + sizeof(buf) - begin));
+}
+
+/* Date and time of day for the most recent second seen by this thread */
+struct WallPrefixCache {
+  int64_t second = INT64_MIN;
+  TimestampStyle style = TimestampStyle::Uptime;
+  size_t len = 0;
+  char text[32];
+};
+static thread_local WallPrefixCache WallPrefix;
+
+/* Wall-clock timestamps reformat the date only when the second changes */
+static void AppendTimestamp(detail::FormatBuffer& out, const RecordHead& head) {
+  TimestampStyle style = ActiveTimestampStyle.load(std::memory_order_relaxed);
+  if (style == TimestampStyle::Uptime) {
+    AppendUptime(out, head);
+    return;
+  }
+  int64_t second = head.wallNs / 1000000000;
+  int64_t subNs = head.wallNs % 1000000000;
+  if (subNs < 0) {
+    subNs += 1000000000;
+    --second;
+  }
+  WallPrefixCache& cache = WallPrefix;
+  if (cache.second != second || cache.style != style) {
+    time_t t = time_t(second);
+    struct tm tmv;
+#if _WIN32
+    if (style == TimestampStyle::UTC)
+      gmtime_s(&tmv, &t);
+    else
+      localtime_s(&tmv, &t);
+#else
+    if (style == TimestampStyle::UTC)
+      gmtime_r(&t, &tmv);
+    else
+      localtime_r(&t, &tmv);
+#endif
+    cache.len = strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S.", &tmv);
+    cache.second = second;
+    cache.style = style;
+  }
+  out.append(cache.text, cache.len);
+  char buf[8];
+  char* end = buf + sizeof(buf);
+  if (style == TimestampStyle::UTC) {
+    *--end = ' ';
+    *--end = 'Z';
+  } else {
+    *--end = ' ';
+  }
+  uint64_t micros = uint64_t(subNs) / 1000;
+  for (int i = 0; i < 6; ++i, micros /= 10)
+    *--end = char('0' + micros % 10);
+  out.append(end, size_t(buf + sizeof(buf) - end));
+}
+
+static void RenderHead(detail::FormatBuffer& out, const HeadStyle& style, const RecordHead& head,
+                       const char* modName, const char* sourceInfo, Level severity) {
+  Append(out, style.open);
+  AppendTimestamp(out, head);
+  if (uint_fast64_t fIdx = head.frameIndex) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    *--end = ' ';
+    *--end = ')';
+    char* begin = detail::FormatDecimal(end, fIdx);
+    *--begin = '(';
+    out.append(begin, size_t(buf + sizeof(buf) - begin));
+  }
+  if (severity >= Info && severity <= Fatal)
+    Append(out, style.severity[severity]);
+  Append(out, style.module);
+  Append(out, modName);
+  if (sourceInfo) {
+    Append(out, style.source);
+    Append(out, sourceInfo);
+    Append(out, style.sourceClose);
+  }
+  if (head.thread.name) {
+    Append(out, style.thread);
+    Append(out, head.thread.name);
+    Append(out, style.threadClose);
+  }
+  Append(out, style.close);
+}
+
+static void RenderMessage(detail::FormatBuffer& out, const char* format, va_list ap) {
+  size_t avail = 512;
+  va_list apc;
+  va_copy(apc, ap);
+  int len = vsnprintf(out.reserve(avail), avail, format, apc);
+  va_end(apc);
+  if (len < 0)
+    return;
+  if (size_t(len) >= avail)
+    vsnprintf(out.reserve(len + 1), len + 1, format, ap);
+  out.commit(len);
+}
+
+/* Appends one conversion rendered by snprintf from a rebuilt narrow spec */
+template <typename T>
+static void AppendConversion(detail::FormatBuffer& out, const char* spec, T value) {
+  size_t avail = 64;
+  int len = snprintf(out.reserve(avail), avail, spec, value);
+  if (len < 0)
+    return;
+  if (size_t(len) >= avail)
+    snprintf(out.reserve(len + 1), len + 1, spec, value);
+  out.commit(size_t(len));
+}
+
+static void AppendPadding(detail::FormatBuffer& out, size_t chars, int width) {
+  if (width > 0 && size_t(width) > chars)
+    out.append(' ', size_t(width) - chars);
+}
+
+/* Wide formats are rendered straight to UTF-8 instead of through vswprintf, which converts
+ * narrow arguments with the C locale, fails outright on truncation and leaves a wide string
+ * to be transcoded afterwards. The format is transcoded once and walked with the binary
+ * logger's spec parser; wide strings and characters are transcoded directly into the output
+ * and every other conversion goes to snprintf. Width and precision of strings count
+ * characters, as in the wide printf family. */
+static void RenderMessage(detail::FormatBuffer& out, const wchar_t* format, va_list ap) {
+  size_t formatLen = wcslen(format);
+  char local[1024];
+  std::unique_ptr<char[]> heap;
+  char* utf8 = local;
+  if (formatLen * 4 >= sizeof(local)) {
+    heap.reset(new char[formatLen * 4 + 1]);
+    utf8 = heap.get();
+  }
+  utf8[WideToUTF8(utf8, format, formatLen)] = '\0';
+
+  va_list apc;
+  va_copy(apc, ap);
+  const char* p = utf8;
+  const char* literal = utf8;
+  binlog::Spec spec;
+  while (binlog::NextSpec(p, spec)) {
+    if (spec.begin != literal)
+      out.append(literal, size_t(spec.begin - literal));
+    literal = spec.end;
+    const char* q = spec.begin + 1;
+    const char* flags = q;
+    bool left = false;
+    while (*q && strchr("-+ #0'", *q))
+      left |= *q++ == '-';
+    size_t flagsLen = std::min<size_t>(size_t(q - flags), 8);
+    int width = 0;
+    if (spec.starWidth) {
+      width = va_arg(apc, int);
+      if (width < 0) {
+        left = true;
+        width = width == INT_MIN ? INT_MAX : -width;
+      }
+    } else {
+      while (*q >= '0' && *q <= '9')
+        width = width * 10 + (*q++ - '0');
+    }
+    int precision = spec.precision;
+    if (spec.starPrecision)
+      precision = va_arg(apc, int);
+    char conv = spec.end > spec.begin + 1 ? spec.end[-1] : '\0';
+    binlog::ArgClass cls = spec.cls;
+#if _WIN32
+    /* MSVC's wide printf family takes plain %s and %c as wide and %S and %C as narrow */
+    bool shortArg = memchr(spec.begin, 'h', size_t(spec.end - spec.begin));
+    if ((conv == 's' || conv == 'c') && !shortArg && spec.size == sizeof(int))
+      cls = conv == 's' ? binlog::ArgClass::WideString : binlog::ArgClass::WideChar;
+    else if (conv == 'S' || conv == 'C')
+      cls = conv == 'S' ? binlog::ArgClass::String : binlog::ArgClass::Unsigned;
+#else
+    if (conv == 'S' || conv == 'C')
+      cls = conv == 'S' ? binlog::ArgClass::WideString : binlog::ArgClass::WideChar;
+#endif
+
+    switch (cls) {
+    case binlog::ArgClass::String:
+    case binlog::ArgClass::WideString: {
+      const wchar_t* wstr = nullptr;
+      const char* str = nullptr;
+      if (cls == binlog::ArgClass::WideString)
+        wstr = va_arg(apc, const wchar_t*);
+      else
+        str = va_arg(apc, const char*);
+      if (!wstr && !str)
+        str = "(null)";
+      size_t len = 0;
+      size_t chars = 0;
+      if (wstr) {
+        while (wstr[len] && (precision < 0 || len < size_t(precision)))
+          ++len;
+        chars = len;
+      } else {
+        /* Narrow arguments are taken as UTF-8 */
+        for (; str[len] && (precision < 0 || chars < size_t(precision)); ++chars) {
+          ++len;
+          while ((uint8_t(str[len]) & 0xC0) == 0x80)
+            ++len;
+        }
+      }
+      if (!left)
+        AppendPadding(out, chars, width);
+      if (wstr)
+        out.commit(WideToUTF8(out.reserve(len * 4), wstr, len));
+      else
+        out.append(str, len);
+      if (left)
+        AppendPadding(out, chars, width);
+      break;
+    }
+    case binlog::ArgClass::WideChar: {
+      wchar_t ch = wchar_t(va_arg(apc, wint_t));
+      if (!left)
+        AppendPadding(out, 1, width);
+      out.commit(WideToUTF8(out.reserve(4), &ch, 1));
+      if (left)
+        AppendPadding(out, 1, width);
+      break;
+    }
+    case binlog::ArgClass::Count:
+      /* Never written, as in the binary logger */
+      va_arg(apc, void*);
+      break;
+    case binlog::ArgClass::None:
+      if (conv == '%')
+        out.append('%', 1);
+      else
+        out.append(spec.begin, size_t(spec.end - spec.begin));
+      break;
+    default: {
+      /* Rebuild the spec with resolved stars and a length modifier matching the value passed */
+      char narrow[48];
+      size_t n = 0;
+      narrow[n++] = '%';
+      memcpy(narrow + n, flags, flagsLen);
+      n += flagsLen;
+      if (left)
+        narrow[n++] = '-';
+      if (width)
+        n += size_t(snprintf(narrow + n, sizeof(narrow) - n, "%d", width));
+      if (precision >= 0)
+        n += size_t(snprintf(narrow + n, sizeof(narrow) - n, ".%d", precision));
+      if (conv == 'c' || conv == 'C') {
+        narrow[n++] = 'c';
+        narrow[n] = '\0';
+        AppendConversion(out, narrow, va_arg(apc, int));
+        break;
+      }
+      if (cls == binlog::ArgClass::Signed || cls == binlog::ArgClass::Unsigned) {
+        narrow[n++] = 'l';
+        narrow[n++] = 'l';
+      } else if (cls == binlog::ArgClass::LongDouble) {
+        narrow[n++] = 'L';
+      }
+      narrow[n++] = conv;
+      narrow[n] = '\0';
+      if (cls == binlog::ArgClass::Signed) {
+        long long v;
+        if (spec.size <= sizeof(int))
+          v = va_arg(apc, int);
+        else if (spec.size == sizeof(long))
+          v = va_arg(apc, long);
+        else
+          v = va_arg(apc, long long);
+        if (spec.size == sizeof(char))
+          v = (signed char)v;
+        else if (spec.size == sizeof(short))
+          v = short(v);
+        AppendConversion(out, narrow, v);
+      } else if (cls == binlog::ArgClass::Unsigned) {
+        unsigned long long v;
+        if (spec.size <= sizeof(int))
+          v = va_arg(apc, unsigned);
+        else if (spec.size == sizeof(long))
+          v = va_arg(apc, unsigned long);
+        else
+          v = va_arg(apc, unsigned long long);
+        if (spec.size == sizeof(char))
+          v = (unsigned char)v;
+        else if (spec.size == sizeof(short))
+          v = (unsigned short)v;
+        AppendConversion(out, narrow, v);
+      } else if (cls == binlog::ArgClass::Double) {
+        AppendConversion(out, narrow, va_arg(apc, double));
+      } else if (cls == binlog::ArgClass::LongDouble) {
+        AppendConversion(out, narrow, va_arg(apc, long double));
+      } else {
+        AppendConversion(out, narrow, va_arg(apc, void*));
+      }
+      break;
+    }
+    }
+  }
+  if (*literal)
+    out.append(literal, strlen(literal));
+  va_end(apc);
+}
+
+/* Flight recorder. Each thread owns a ring of fixed-size slots that only it writes;
+ * rings are linked into a list that never shrinks, so a crashing thread can walk
+ * every ring without locks. A slot's sequence is odd while it is being written. */
+static constexpr size_t FlightTextSize = 232;
+
+struct FlightSlot {
+  std::atomic<uint32_t> seq{0};
+  uint8_t severity = 0;
+  uint16_t len = 0;
+  const char* modName = nullptr;
+  const char* threadName = nullptr;
+  uint64_t uptimeNs = 0;
+  char text[FlightTextSize];
+};
+
+struct FlightRing {
+  FlightRing* next = nullptr;
+  std::atomic<bool> inUse{true};
+  std::atomic<uint64_t> written{0};
+  unsigned capacity = 0;
+  std::unique_ptr<FlightSlot[]> slots;
+};
+
+std::atomic<int> _FlightLevel(Warning);
+static std::atomic<unsigned> FlightCapacity(64);
+static std::atomic<FlightRing*> FlightRings(nullptr);
+static std::atomic_bool FlightDumped(false);
+
+/* Hands the ring back to the pool when its thread exits; its records stay dumpable */
+struct FlightRingHolder {
+  FlightRing* ring = nullptr;
+  ~FlightRingHolder() {
+    if (ring)
+      ring->inUse.store(false, std::memory_order_release);
+  }
+};
+static thread_local FlightRingHolder CurrentFlightRing;
+
+static FlightRing* AcquireFlightRing() {
+  FlightRingHolder& holder = CurrentFlightRing;
+  unsigned capacity = FlightCapacity.load(std::memory_order_relaxed);
+  if (holder.ring && holder.ring->capacity == capacity)
+    return holder.ring;
+  if (holder.ring)
+    holder.ring->inUse.store(false, std::memory_order_release);
+  holder.ring = nullptr;
+
+  for (FlightRing* ring = FlightRings.load(std::memory_order_acquire); ring; ring = ring->next) {
+    bool expected = false;
+    if (ring->capacity == capacity && !ring->inUse.load(std::memory_order_relaxed) &&
+        ring->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      holder.ring = ring;
+      return ring;
+    }
+  }
+
+  FlightRing* ring = new FlightRing;
+  ring->capacity = capacity;
+  ring->slots.reset(new FlightSlot[capacity]);
+  ring->next = FlightRings.load(std::memory_order_relaxed);
+  while (!FlightRings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  holder.ring = ring;
+  return ring;
+}
+
+/* fill(text, capacity) writes the message and returns its length */
+template <typename Fill>
+static void RecordFlight(const char* modName, Level severity, Fill&& fill) {
+  FlightRing* ring = AcquireFlightRing();
+  uint64_t index = ring->written.load(std::memory_order_relaxed);
+  FlightSlot& slot = ring->slots[index % ring->capacity];
+  uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.severity = uint8_t(severity);
+  slot.modName = modName;
+  slot.threadName = CurrentThread.info.name;
+  slot.uptimeNs = CurrentUptimeNs();
+  slot.len = uint16_t(std::min(fill(slot.text, FlightTextSize), FlightTextSize));
+  slot.seq.store(seq + 2, std::memory_order_release);
+  ring->written.store(index + 1, std::memory_order_relaxed);
+}
+
+/* Backs off to the start of a UTF-8 sequence so truncation never splits a character */
+static size_t TrimUTF8(const char* text, size_t len, size_t cap) {
+  if (len < cap)
+    return len;
+  len = cap;
+  while (len && (uint8_t(text[len]) & 0xC0) == 0x80)
+    --len;
+  return len;
+}
+
+static bool FlightEnabled(Level severity) { return severity >= _FlightLevel.load(std::memory_order_relaxed); }
+
+/* Captures the message a delivered report already rendered for its loggers */
+static void RecordFlightText(const char* modName, Level severity, std::string_view text) {
+  RecordFlight(modName, severity, [&](char* out, size_t cap) -> size_t {
+    size_t len = TrimUTF8(text.data(), text.size(), cap);
+    memcpy(out, text.data(), len);
+    return len;
+  });
+}
+
+/* Flight-only reports, kept from the loggers by Module::level() or a SitePolicy, are
+ * rendered straight into the slot */
+void _RecordFlight(const char* modName, Level severity, const char* format, va_list ap) {
+  RecordFlight(modName, severity, [&](char* text, size_t cap) -> size_t {
+    va_list apc;
+    va_copy(apc, ap);
+    int len = vsnprintf(text, cap, format, apc);
+    va_end(apc);
+    return len < 0 ? 0 : TrimUTF8(text, size_t(len), cap - 1);
+  });
+}
+
+void _RecordFlight(const char* modName, Level severity, const wchar_t* format, va_list ap) {
+  RecordFlight(modName, severity, [&](char* text, size_t cap) -> size_t {
+    detail::ScopedFormatBuffer buf;
+    RenderMessage(*buf, format, ap);
+    size_t len = TrimUTF8(buf->data(), buf->size(), cap);
+    memcpy(text, buf->data(), len);
+    return len;
+  });
+}
+
+void _RecordFlightText(const char* modName, Level severity, const char* text) {
+  RecordFlightText(modName, severity, text);
+}
+
+void EnableFlightRecorder(unsigned recordsPerThread, Level minLevel) {
+  FlightCapacity.store(std::max(recordsPerThread, 1u), std::memory_order_relaxed);
+  _FlightLevel.store(minLevel, std::memory_order_relaxed);
+}
+
+void DisableFlightRecorder() { _FlightLevel.store(Fatal + 1, std::memory_order_relaxed); }
+
+/* Fixed-size line builder for signal context; no allocation, no stdio */
+struct SignalSafeLine {
+  char buf[FlightTextSize + 256];
+  size_t len = 0;
+
+  void put(const char* str, size_t strLen) {
+    strLen = std::min(strLen, sizeof(buf) - len);
+    memcpy(buf + len, str, strLen);
+    len += strLen;
+  }
+  void put(const char* str) {
+    if (str)
+      put(str, strlen(str));
+  }
+  void putUint(uint64_t v, unsigned minDigits = 1) {
+    char digits[20];
+    unsigned n = 0;
+    do {
+      digits[n++] = char('0' + v % 10);
+      v /= 10;
+    } while (v || n < minDigits);
+    while (n && len < sizeof(buf))
+      buf[len++] = digits[--n];
+  }
+  void putHex(uint64_t v) {
+    char digits[16];
+    unsigned n = 0;
+    do {
+      digits[n++] = "0123456789abcdef"[v & 0xf];
+      v >>= 4;
+    } while (v);
+    while (n && len < sizeof(buf))
+      buf[len++] = digits[--n];
+  }
+  /* Ends the line even when the text filled the buffer */
+  void endLine() {
+    if (len == sizeof(buf))
+      --len;
+    buf[len++] = '\n';
+  }
+  void write(int fd) {
+    const char* data = buf;
+    size_t remaining = len;
+    while (remaining) {
+#if _WIN32
+      int written = _write(fd, data, unsigned(remaining));
+#else
+      ssize_t written = ::write(fd, data, remaining);
+      if (written < 0 && errno == EINTR)
+        continue;
+#endif
+      if (written <= 0)
+        break;
+      data += written;
+      remaining -= size_t(written);
+    }
+    len = 0;
+  }
+};
+
+void DumpFlightRecorder(int fd) {
+  static constexpr const char* SeverityNames[] = {"INFO", "WARNING", "ERROR", "FATAL ERROR"};
+  SignalSafeLine line;
+  line.put("--- flight recorder ---\n");
+  line.write(fd);
+
+  /* Selection merge by (uptime, ring, slot): quadratic, but needs no scratch memory */
+  struct Key {
+    uint64_t uptimeNs;
+    uintptr_t ring;
+    size_t slot;
+    bool operator<(const Key& other) const {
+      if (uptimeNs != other.uptimeNs)
+        return uptimeNs < other.uptimeNs;
+      if (ring != other.ring)
+        return ring < other.ring;
+      return slot < other.slot;
+    }
+  };
+  bool havePrev = false;
+  Key prev = {};
+  for (;;) {
+    bool found = false;
+    Key best = {};
+    FlightSlot copy;
+    for (FlightRing* ring = FlightRings.load(std::memory_order_acquire); ring; ring = ring->next) {
+      for (size_t i = 0; i < ring->capacity; ++i) {
+        const FlightSlot& slot = ring->slots[i];
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (!seq || (seq & 1))
+          continue;
+        Key key = {slot.uptimeNs, uintptr_t(ring), i};
+        if ((havePrev && !(prev < key)) || (found && !(key < best)))
+          continue;
+        copy.severity = slot.severity;
+        copy.len = slot.len;
+        copy.modName = slot.modName;
+        copy.threadName = slot.threadName;
+        copy.uptimeNs = slot.uptimeNs;
+        memcpy(copy.text, slot.text, std::min(size_t(slot.len), FlightTextSize));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq || copy.uptimeNs != key.uptimeNs)
+          continue;
+        best = key;
+        found = true;
+        /* Retain the validated copy for the winning slot */
+        line.len = 0;
+        line.put("[");
+        line.putUint(copy.uptimeNs / 1000000000);
+        line.put(".");
+        line.putUint(copy.uptimeNs % 1000000000 / 100000, 4);
+        line.put(" ");
+        line.put(copy.severity <= Fatal ? SeverityNames[copy.severity] : "");
+        line.put(" ");
+        line.put(copy.modName);
+        if (copy.threadName) {
+          line.put(" (");
+          line.put(copy.threadName);
+          line.put(")");
+        }
+        line.put("] ");
+        line.put(copy.text, copy.len);
+        line.put("\n");
+      }
+    }
+    if (!found)
+      break;
+    line.write(fd);
+    prev = best;
+    havePrev = true;
+  }
+
+  line.put("--- end flight recorder ---\n");
+  line.write(fd);
+}
+
+/* Stack trace for crash paths: frames are symbolized from the prepared index, left
+ * mangled, and written one line at a time from a stack buffer */
+static void CrashWriteBacktrace(int fd, unsigned skipFrames) {
+#if !_WIN32 && !defined(__SWITCH__)
+  void* frames[128];
+  int count = backtrace(frames, 128);
+  SignalSafeLine line;
+  for (int i = int(skipFrames) + 1; i < count; ++i) {
+    line.put("#");
+    line.putUint(unsigned(i) - skipFrames - 1);
+    line.put(" 0x");
+    line.putHex(uintptr_t(frames[i]));
+    SymbolInfo info;
+    if (CrashSymbolize(frames[i], info)) {
+      if (info.symbol) {
+        line.put(" ");
+        line.put(info.symbol);
+        line.put("+0x");
+        line.putHex(info.offset);
+      }
+      if (info.object) {
+        line.put(" (");
+        line.put(info.object);
+        if (!info.symbol) {
+          line.put("+0x");
+          line.putHex(info.offset);
+        }
+        line.put(")");
+      }
+    }
+    line.endLine();
+    line.write(fd);
+  }
+#endif
+}
+
+/* Descriptors of open plain-text file logs, stored plus one so zero is an empty slot.
+ * A crash loses whatever their stdio buffers hold; AbortHandler appends the flight
+ * recorder and the FATAL line to each one with write(2) instead. */
+static std::atomic<int> CrashFileFds[16];
+
+static int FileDescriptor(FILE* fp) {
+#if _WIN32
+  return _fileno(fp);
+#else
+  return fileno(fp);
+#endif
+}
+
+static void AddCrashFile(FILE* fp) {
+  int fd = FileDescriptor(fp);
+  for (std::atomic<int>& slot : CrashFileFds) {
+    int empty = 0;
+    if (slot.compare_exchange_strong(empty, fd + 1))
+      return;
+  }
+}
+
+/* Must run before fp is closed, so a reused descriptor never receives a crash dump */
+static void RemoveCrashFile(FILE* fp) {
+  int fd = FileDescriptor(fp);
+  for (std::atomic<int>& slot : CrashFileFds) {
+    int expected = fd + 1;
+    if (slot.compare_exchange_strong(expected, 0))
+      return;
+  }
+}
+
+/* Dumps once per process to stderr, whichever crash path gets there first */
+static void CrashDumpFlightRecorder() {
+  if (!FlightDumped.exchange(true))
+    DumpFlightRecorder(2);
+}
+
+/* Runs in signal context, so it only writes fixed text with write(2). The default action is
+ * then restored and the signal raised again, so the process dies (and dumps core) as usual. */
+static void AbortHandler(int signum) {
+  CrashDumpFlightRecorder();
+  SignalSafeLine line;
+  line.put("FATAL ERROR: ");
+  switch (signum) {
+  case SIGSEGV:
+    line.put("Segmentation Fault");
+    break;
+  case SIGILL:
+    line.put("Bad Execution");
+    break;
+  case SIGFPE:
+    line.put("Floating Point Exception");
+    break;
+  case SIGABRT:
+    line.put("Abort Signal");
+    break;
+  default:
+    line.put("unknown signal ");
+    line.putUint(unsigned(signum));
+    break;
+  }
+  line.put("\n");
+  for (std::atomic<int>& slot : CrashFileFds) {
+    if (int fd = slot.load() - 1; fd >= 0) {
+      DumpFlightRecorder(fd);
+      SignalSafeLine fileLine = line;
+      fileLine.write(fd);
+    }
+  }
+  line.write(2);
+#if _WIN32
+  KillProcessTree();
+#else
+  CrashWriteBacktrace(2, 1);
+#endif
+  signal(signum, SIG_DFL);
+  raise(signum);
+}
+
+/* Records are rendered into one per-thread buffer and emitted with a single write */
+static thread_local detail::FormatBuffer RenderBuffer;
+
+static void AppendFieldValue(detail::FormatBuffer& out, const LogField& field) {
+  detail::FieldSpec spec;
+  switch (field.type) {
+  case LogField::Signed:
+    detail::WriteArg(out, spec, field.i);
+    break;
+  case LogField::Unsigned:
+    detail::WriteArg(out, spec, field.u);
+    break;
+  case LogField::Float:
+    detail::WriteArg(out, spec, field.f);
+    break;
+  case LogField::Bool:
+    detail::WriteArg(out, spec, field.b);
+    break;
+  case LogField::String:
+    detail::WriteArg(out, spec, std::string_view(field.str.data, field.str.size));
+    break;
+  case LogField::Pointer:
+    detail::WriteArg(out, spec, field.p);
+    break;
+  }
+}
+
+/* Fields as " key=value" text, for loggers without structured output; strings are quoted */
+static void AppendFieldText(detail::FormatBuffer& out, const LogField* fields, size_t fieldCount) {
+  for (size_t i = 0; i < fieldCount; ++i) {
+    out.append(' ', 1);
+    Append(out, fields[i].key);
+    out.append('=', 1);
+    if (fields[i].type == LogField::String) {
+      out.append('"', 1);
+      const char* str = fields[i].str.data;
+      const char* end = str + fields[i].str.size;
+      for (const char* run = str; str <= end; ++str) {
+        if (str < end && *str != '"' && *str != '\\')
+          continue;
+        out.append(run, str - run);
+        if (str < end)
+          out.append("\\", 1);
+        run = str;
+      }
+      out.append('"', 1);
+    } else {
+      AppendFieldValue(out, fields[i]);
+    }
+  }
+}
+
+static void ForwardToLogger(ILogger& logger, const char* modName, Level severity, const char* file, unsigned linenum,
+                            const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  if (file)
+    logger.reportSource(modName, severity, file, linenum, format, ap);
+  else
+    logger.report(modName, severity, format, ap);
+  va_end(ap);
+}
+
+/* Separate from RenderBuffer, which the forwarded-to logger renders into */
+static thread_local detail::FormatBuffer FieldTextBuffer;
+
+void ILogger::reportFields(const char* modName, Level severity, const char* file, unsigned linenum,
+                           const LogField* fields, size_t fieldCount, const char* format, va_list ap) {
+  detail::FormatBuffer& msg = FieldTextBuffer;
+  msg.clear();
+  RenderMessage(msg, format, ap);
+  AppendFieldText(msg, fields, fieldCount);
+  ForwardToLogger(*this, modName, severity, file, linenum, "%s", msg.c_str());
+}
+
+static inline RecordHead HeadOf(const LogRecord& record) {
+  return {record.uptimeNs, record.wallNs, record.frameIndex, record.thread};
+}
+
+/* Deliveries are serialized by the log lock, so the count needs no read-modify-write */
+static inline void CountRecords(ILogger& logger, uint64_t n) {
+  logger.m_recordsWritten.store(logger.m_recordsWritten.load(std::memory_order_relaxed) + n,
+                                std::memory_order_relaxed);
+}
+
+/* Instrumentation. Each thread owns a shard that only it writes, so counters are bumped
+ * with relaxed load/store pairs instead of atomic read-modify-writes; GetLogStats() sums
+ * every shard. Shards outlive their threads and are reused, so no counts are lost. */
+static constexpr size_t StatsModuleSlots = 128;
+static constexpr size_t StatsModuleProbes = 8;
+
+struct StatsCounter {
+  std::atomic<uint64_t> value{0};
+  void add(uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+struct ModuleCounters {
+  std::atomic<const char*> name{nullptr};
+  StatsCounter reports[4];
+  StatsCounter latencyNs;
+};
+
+struct StatsShard {
+  ModuleCounters modules[StatsModuleSlots];
+  ModuleCounters overflow; /* Modules that found no free slot */
+  StatsCounter suppressed;
+  StatsCounter asyncDropped;
+  StatsCounter lockWaits;
+  StatsCounter lockWaitNs;
+  StatsCounter latency[LogStats::HistogramBuckets];
+  StatsCounter lockWait[LogStats::HistogramBuckets];
+  std::atomic<bool> active{true};
+  StatsShard* next = nullptr;
+};
+static std::atomic<StatsShard*> StatsShards(nullptr);
+
+static StatsShard* AcquireStatsShard() {
+  for (StatsShard* shard = StatsShards.load(std::memory_order_acquire); shard; shard = shard->next) {
+    bool idle = false;
+    if (!shard->active.load(std::memory_order_relaxed) && shard->active.compare_exchange_strong(idle, true))
+      return shard;
+  }
+  StatsShard* shard = new StatsShard;
+  StatsShard* head = StatsShards.load(std::memory_order_relaxed);
+  do
+    shard->next = head;
+  while (!StatsShards.compare_exchange_weak(head, shard, std::memory_order_release, std::memory_order_relaxed));
+  return shard;
+}
+
+struct ThreadStats {
+  StatsShard* shard = nullptr;
+  ~ThreadStats() {
+    if (shard)
+      shard->active.store(false, std::memory_order_release);
+  }
+  StatsShard& get() {
+    if (!shard)
+      shard = AcquireStatsShard();
+    return *shard;
+  }
+};
+static thread_local ThreadStats CurrentStats;
+
+static ModuleCounters& CountersFor(StatsShard& shard, const char* modName) {
+  size_t hash = size_t((uint64_t(uintptr_t(modName)) * 0x9E3779B97F4A7C15ull) >> 40);
+  for (size_t probe = 0; probe < StatsModuleProbes; ++probe) {
+    ModuleCounters& slot = shard.modules[(hash + probe) & (StatsModuleSlots - 1)];
+    const char* cur = slot.name.load(std::memory_order_relaxed);
+    if (cur == modName)
+      return slot;
+    if (!cur) {
+      slot.name.store(modName, std::memory_order_release);
+      return slot;
+    }
+  }
+  return shard.overflow;
+}
+
+static inline size_t HistogramBucket(uint64_t ns) {
+  return ns ? std::min(size_t(std::bit_width(ns) - 1), LogStats::HistogramBuckets - 1) : 0;
+}
+
+/* Accounts a synchronous report; times are CurrentUptimeNs() readings */
+static void CountReport(const char* modName, Level severity, uint64_t start, uint64_t done) {
+  StatsShard& shard = CurrentStats.get();
+  ModuleCounters& counters = CountersFor(shard, modName);
+  counters.reports[severity].add(1);
+  counters.latencyNs.add(done - start);
+  shard.latency[HistogramBucket(done - start)].add(1);
+}
+
+static void CountLockWait(uint64_t start, uint64_t locked) {
+  StatsShard& shard = CurrentStats.get();
+  shard.lockWaits.add(1);
+  shard.lockWaitNs.add(locked - start);
+  shard.lockWait[HistogramBucket(locked - start)].add(1);
+}
+
+/* Accounts a report handed to the asynchronous queue */
+static void CountQueuedReport(const char* modName, Level severity) {
+  CountersFor(CurrentStats.get(), modName).reports[severity].add(1);
+}
+
+uint64_t LogStats::Percentile(const uint64_t (&histogram)[HistogramBuckets], double fraction) {
+  uint64_t total = 0;
+  for (uint64_t count : histogram)
+    total += count;
+  if (!total)
+    return 0;
+  uint64_t target = std::max(uint64_t(std::ceil(double(total) * fraction)), uint64_t(1));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HistogramBuckets; ++i) {
+    seen += histogram[i];
+    if (seen >= target)
+      return (uint64_t(2) << i) - 1;
+  }
+  return UINT64_MAX;
+}
+
+LogStats GetLogStats() {
+  LogStats stats;
+  std::unordered_map<std::string_view, size_t> moduleIndex;
+  auto addModule = [&](const ModuleCounters& counters, const char* name) {
+    auto [it, inserted] = moduleIndex.try_emplace(name, stats.modules.size());
+    if (inserted)
+      stats.modules.push_back({name, {}, 0});
+    LogStats::ModuleStats& mod = stats.modules[it->second];
+    for (int i = 0; i < 4; ++i)
+      mod.reports[i] += counters.reports[i].get();
+    mod.latencyNs += counters.latencyNs.get();
+  };
+  for (StatsShard* shard = StatsShards.load(std::memory_order_acquire); shard; shard = shard->next) {
+    for (const ModuleCounters& counters : shard->modules)
+      if (const char* name = counters.name.load(std::memory_order_acquire))
+        addModule(counters, name);
+    addModule(shard->overflow, "(other)");
+    stats.suppressed += shard->suppressed.get();
+    stats.asyncDropped += shard->asyncDropped.get();
+    stats.lockWaits += shard->lockWaits.get();
+    stats.lockWaitNs += shard->lockWaitNs.get();
+    for (size_t i = 0; i < LogStats::HistogramBuckets; ++i) {
+      stats.latency[i] += shard->latency[i].get();
+      stats.lockWait[i] += shard->lockWait[i].get();
+    }
+  }
+  auto total = [](const LogStats::ModuleStats& mod) {
+    return mod.reports[0] + mod.reports[1] + mod.reports[2] + mod.reports[3];
+  };
+  stats.modules.erase(std::remove_if(stats.modules.begin(), stats.modules.end(),
+                                     [&](const LogStats::ModuleStats& mod) { return !total(mod); }),
+                      stats.modules.end());
+  std::stable_sort(stats.modules.begin(), stats.modules.end(),
+                   [&](const LogStats::ModuleStats& a, const LogStats::ModuleStats& b) { return total(a) > total(b); });
+  for (const LogStats::ModuleStats& mod : stats.modules)
+    stats.reports += total(mod);
+  for (ILogger* logger : MainLoggers.snapshot())
+    stats.sinks.push_back({logger->describe(), logger->m_recordsWritten.load(std::memory_order_relaxed),
+                           logger->m_bytesWritten.load(std::memory_order_relaxed)});
+  stats.errors = ErrorCount.load();
+  return stats;
+}
+
+/* Message text shared by the sinks of one report. A sink that reports from inside
+ * write() starts a nested delivery, which renders into a private buffer instead. */
+static thread_local detail::FormatBuffer SinkMessageBuffer;
+static thread_local unsigned SinkDepth = 0;
+
+/* Fills record with the header and rendered message of one report. Messages that were
+ * already rendered by format() or the async queue arrive as "%s" and are not copied. */
+template <typename CharType>
+static void BuildRecord(LogRecord& record, detail::FormatBuffer& msg, char (&sourceInfo)[128], const RecordHead& head,
+                        const char* modName, Level severity, const char* file, unsigned linenum,
+                        const LogField* fields, size_t fieldCount, const CharType* format, va_list ap) {
+  record.modName = modName;
+  record.severity = severity;
+  record.file = file;
+  record.linenum = linenum;
+  record.sourceInfo = nullptr;
+  if (file) {
+    snprintf(sourceInfo, sizeof(sourceInfo), "%s:%u", file, linenum);
+    record.sourceInfo = sourceInfo;
+  }
+  record.uptimeNs = head.uptimeNs;
+  record.wallNs = head.wallNs;
+  record.frameIndex = head.frameIndex;
+  record.thread = head.thread;
+  record.fields = fields;
+  record.fieldCount = fieldCount;
+  if constexpr (std::is_same_v<CharType, char>) {
+    if (format[0] == '%' && format[1] == 's' && !format[2]) {
+      va_list apc;
+      va_copy(apc, ap);
+      const char* text = va_arg(apc, const char*);
+      va_end(apc);
+      record.message = text ? std::string_view(text) : std::string_view("(null)");
+      return;
+    }
+  }
+  msg.clear();
+  /* Loggers that aren't sinks may still need the arguments afterwards */
+  va_list apc;
+  va_copy(apc, ap);
+  RenderMessage(msg, format, apc);
+  va_end(apc);
+  record.message = std::string_view(msg.data() ? msg.data() : "", msg.size());
+}
+
+/* Formats once for every sink; loggers that aren't sinks get the format and arguments.
+ * Caller must hold the log lock. */
+template <typename CharType>
+static void DeliverReport(const char* modName, Level severity, const char* file, unsigned linenum,
+                          const LogField* fields, size_t fieldCount, const CharType* format, va_list ap) {
+  detail::FormatBuffer nested;
+  detail::FormatBuffer& msg = SinkDepth ? nested : SinkMessageBuffer;
+  LogRecord record;
+  char sourceInfo[128];
+  bool built = false;
+  /* Sinks and loggers that aren't sinks are all stamped with this one head */
+  RecordHead head = CaptureHead();
+  /* Replayed async records were captured by their producer */
+  if (!ReplayHead && FlightEnabled(severity)) {
+    BuildRecord(record, msg, sourceInfo, head, modName, severity, file, linenum, fields, fieldCount, format, ap);
+    built = true;
+    RecordFlightText(modName, severity, record.message);
+  }
+  ++SinkDepth;
+  for (ILogger* logger : MainLoggers.snapshot()) {
+    CountRecords(*logger, 1);
+    if (LogSink* sink = logger->asSink()) {
+      if (!built) {
+        BuildRecord(record, msg, sourceInfo, head, modName, severity, file, linenum, fields, fieldCount, format, ap);
+        built = true;
+      }
+      sink->write(record);
+      continue;
+    }
+    /* CaptureHead() in the logger returns the head the sinks received */
+    const RecordHead* prevHead = ReplayHead;
+    ReplayHead = &head;
+    va_list apc;
+    va_copy(apc, ap);
+    if constexpr (std::is_same_v<CharType, char>) {
+      if (fieldCount)
+        logger->reportFields(modName, severity, file, linenum, fields, fieldCount, format, apc);
+      else if (file)
+        logger->reportSource(modName, severity, file, linenum, format, apc);
+      else
+        logger->report(modName, severity, format, apc);
+    } else if (file) {
+      logger->reportSource(modName, severity, file, linenum, format, apc);
+    } else {
+      logger->report(modName, severity, format, apc);
+    }
+    va_end(apc);
+    ReplayHead = prevHead;
+  }
+  --SinkDepth;
+}
+
+/* Synchronous delivery of a report that has passed all filters */
+template <typename CharType>
+static void ReportSync(const char* modName, Level severity, const char* file, unsigned linenum,
+                       const LogField* fields, size_t fieldCount, const CharType* format, va_list ap);
+
+void _ReportSync(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                 va_list ap) {
+  ReportSync(modName, severity, file, linenum, nullptr, 0, format, ap);
+}
+
+void _ReportSync(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                 va_list ap) {
+  ReportSync(modName, severity, file, linenum, nullptr, 0, format, ap);
+}
+
+template <typename CharType>
+static void WriteSink(LogSink& sink, const char* modName, Level severity, const char* file, unsigned linenum,
+                      const LogField* fields, size_t fieldCount, const CharType* format, va_list ap) {
+  detail::FormatBuffer nested;
+  detail::FormatBuffer& msg = SinkDepth ? nested : SinkMessageBuffer;
+  LogRecord record;
+  char sourceInfo[128];
+  ++SinkDepth;
+  BuildRecord(record, msg, sourceInfo, CaptureHead(), modName, severity, file, linenum, fields, fieldCount, format,
+              ap);
+  sink.write(record);
+  --SinkDepth;
+}
+
+void LogSink::report(const char* modName, Level severity, const char* format, va_list ap) {
+  WriteSink(*this, modName, severity, nullptr, 0, nullptr, 0, format, ap);
+}
+
+void LogSink::report(const char* modName, Level severity, const wchar_t* format, va_list ap) {
+  WriteSink(*this, modName, severity, nullptr, 0, nullptr, 0, format, ap);
+}
+
+void LogSink::reportSource(const char* modName, Level severity, const char* file, unsigned linenum,
+                           const char* format, va_list ap) {
+  WriteSink(*this, modName, severity, file, linenum, nullptr, 0, format, ap);
+}
+
+void LogSink::reportSource(const char* modName, Level severity, const char* file, unsigned linenum,
+                           const wchar_t* format, va_list ap) {
+  WriteSink(*this, modName, severity, file, linenum, nullptr, 0, format, ap);
+}
+
+void LogSink::reportFields(const char* modName, Level severity, const char* file, unsigned linenum,
+                           const LogField* fields, size_t fieldCount, const char* format, va_list ap) {
+  WriteSink(*this, modName, severity, file, linenum, fields, fieldCount, format, ap);
+}
+
+/* Message followed by any fields as key=value text, for sinks writing plain text */
+static void AppendRecordText(detail::FormatBuffer& out, const LogRecord& record) {
+  out.append(record.message.data(), record.message.size());
+  AppendFieldText(out, record.fields, record.fieldCount);
+}
+
+#if _WIN32
+static HANDLE Term = 0;
+#else
+static const char* Term = nullptr;
+#endif
+bool XtermColor = false;
+struct ConsoleLogger : public LogSink {
+  ConsoleLogger() {
+#if _WIN32
+#if !WINDOWS_STORE
+    const char* conemuANSI = getenv("ConEmuANSI");
+    if (conemuANSI && !strcmp(conemuANSI, "ON"))
+      XtermColor = true;
+#endif
+    if (!Term)
+      Term = GetStdHandle(STD_ERROR_HANDLE);
+#else
+    if (!Term) {
+      Term = getenv("TERM");
+      if (Term && !strncmp(Term, "xterm", 5)) {
+        XtermColor = true;
+        putenv((char*)"TERM=xterm-16color");
+      }
+    }
+#endif
+#if !_WIN32 && !defined(__SWITCH__)
+    static bool installedWinch = false;
+    if (!installedWinch) {
+      struct sigaction action = {};
+      action.sa_handler = WinchHandler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      sigaction(SIGWINCH, &action, &PrevWinchAction);
+      installedWinch = true;
+    }
+#endif
+  }
+
+#if _WIN32
+  /* Console attributes must be set between writes, so this path can't be batched */
+  static void _reportHeadWin32(const RecordHead& head, const char* modName, const char* sourceInfo,
+                               Level severity) {
+#if !WINDOWS_STORE
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    fprintf(stderr, "[");
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN);
+    detail::FormatBuffer stamp;
+    AppendTimestamp(stamp, head);
+    fwrite(stamp.data(), 1, stamp.size(), stderr);
+    uint64_t fi = head.frameIndex;
+    if (fi)
+      fprintf(stderr, "(%" PRIu64 ") ", fi);
+    switch (severity) {
+    case Info:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE);
+      fprintf(stderr, "INFO");
+      break;
+    case Warning:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
+      fprintf(stderr, "WARNING");
+      break;
+    case Error:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
+      fprintf(stderr, "ERROR");
+      break;
+    case Fatal:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
+      fprintf(stderr, "FATAL ERROR");
+      break;
+    default:
+      break;
+    };
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    fprintf(stderr, " %s", modName);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
+    if (sourceInfo)
+      fprintf(stderr, " {%s}", sourceInfo);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE);
+    if (head.thread.name)
+      fprintf(stderr, " (%s)", head.thread.name);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    fprintf(stderr, "] ");
+    SetConsoleTextAttribute(Term, FOREGROUND_WHITE);
+#endif
+  }
+#endif
+
+  static void clearLine(detail::FormatBuffer& out) {
+    int width = ConsoleWidth();
+    out.append('\r', 1);
+    out.append(' ', width);
+    out.append('\r', 1);
+  }
+
+  void write(const LogRecord& record) {
+    detail::FormatBuffer& out = RenderBuffer;
+    out.clear();
+
+    /* Clear current line out */
+    clearLine(out);
+
+    RecordHead head = HeadOf(record);
+#if _WIN32
+    if (!XtermColor) {
+      fwrite(out.data(), 1, out.size(), stderr);
+      out.clear();
+      _reportHeadWin32(head, record.modName, record.sourceInfo, record.severity);
+    } else
+#endif
+      RenderHead(out, XtermColor ? XtermStyle : PlainStyle, head, record.modName, record.sourceInfo,
+                 record.severity);
+
+    AppendRecordText(out, record);
+    out.append('\n', 1);
+    fwrite(out.data(), 1, out.size(), stderr);
+    fflush(stderr);
+    countBytes(out.size());
+  }
+
+  void writeBatch(const LogRecord* records, size_t count) {
+#if _WIN32
+    if (!XtermColor) {
+      LogSink::writeBatch(records, count);
+      return;
+    }
+#endif
+    detail::FormatBuffer& out = RenderBuffer;
+    out.clear();
+    clearLine(out);
+    for (size_t i = 0; i < count; ++i) {
+      RenderHead(out, XtermColor ? XtermStyle : PlainStyle, HeadOf(records[i]), records[i].modName,
+                 records[i].sourceInfo, records[i].severity);
+      AppendRecordText(out, records[i]);
+      out.append('\n', 1);
+    }
+    fwrite(out.data(), 1, out.size(), stderr);
+    fflush(stderr);
+    countBytes(out.size());
+  }
+
+  std::string describe() const { return "console"; }
+};
+
+void RegisterConsoleLogger() {
+  /* Otherwise construct new console logger */
+  MainLoggers.emplace_back(new ConsoleLogger);
+}
+
+#if _WIN32
+void CreateWin32Console() {
+#if !WINDOWS_STORE
+  /* Debug console */
+  AllocConsole();
+
+  freopen("CONIN$", "r", stdin);
+  freopen("CONOUT$", "w", stdout);
+  freopen("CONOUT$", "w", stderr);
+#endif
+}
+#endif
+
+void RegisterStandardExceptions() {
+  PrepareSymbolizer();
+  signal(SIGABRT, AbortHandler);
+  signal(SIGSEGV, AbortHandler);
+  signal(SIGILL, AbortHandler);
+  signal(SIGFPE, AbortHandler);
+}
+
+struct FileLogger : public LogSink {
+  FILE* fp = nullptr;
+  FileLoggerOptions m_options;
+  std::unique_ptr<char[]> m_buffer;
+  std::vector<uint8_t> m_block;
+  size_t m_blockLen = 0;
+  std::vector<uint8_t> m_packed;
+  uint64_t m_written = 0;
+  std::chrono::steady_clock::time_point m_lastFlush;
+  std::chrono::system_clock::time_point m_nextRotate;
+  FILE* m_indexFp = nullptr;
+  logindex::Entry m_indexRun = {}; /* Records since the last index entry */
+  unsigned m_sameSecond = 0;       /* Timestamped rotations already made within m_lastSecond */
+  time_t m_lastSecond = 0;
+
+  /* Rotation helper: closes rotated-out streams, each with its own buffer, and opens
+   * "<path>.next" ahead of time so rotating is a rename. State below is under m_helperMutex. */
+  struct ClosingFile {
+    FILE* fp;
+    std::unique_ptr<char[]> buffer;
+  };
+  std::thread m_helper;
+  std::mutex m_helperMutex;
+  std::condition_variable m_helperCond;
+  std::vector<ClosingFile> m_closing;
+  bool m_wantNext = false;
+  bool m_helperStop = false;
+  FILE* m_nextFp = nullptr;
+  FILE* m_nextIndexFp = nullptr;
+  std::unique_ptr<char[]> m_nextBuffer;
+
+  explicit FileLogger(const FileLoggerOptions& options) : m_options(options) {
+    if (m_options.bufferSize)
+      m_buffer.reset(new char[m_options.bufferSize]);
+    if (m_options.compression == FileCompression::LZ4) {
+      m_options.blockSize = std::clamp(m_options.blockSize, size_t(4096), blockz::MaxBlockSize);
+      m_block.resize(m_options.blockSize);
+      m_packed.resize(blockz::FrameHeaderSize + blockz::CompressBound(m_options.blockSize));
+    }
+  }
+  /* Subclasses call stopHelper() first; the helper opens files through their virtuals */
+  ~FileLogger() {
+    if (fp) {
+      writeBlock();
+      RemoveCrashFile(fp);
+      fclose(fp);
+    }
+    closeIndex();
+  }
+
+  /* Open "<path><suffix>" for appending */
+  virtual FILE* openFile(const char* suffix, const char* mode) = 0;
+  /* Rename "<path><fromSuffix>" to "<path><toSuffix>"; an empty suffix is the live file */
+  virtual int renameFile(const char* fromSuffix, const char* toSuffix) = 0;
+  virtual int removeFile(const char* suffix) = 0;
+
+  bool ensureOpen() {
+    if (fp)
+      return true;
+    /* Index offsets count bytes, so indexed logs are written without newline translation */
+    fp = openFile("", indexing() ? "ab" : "a");
+    if (!fp)
+      return false;
+    if (m_buffer)
+      setvbuf(fp, m_buffer.get(), _IOFBF, m_options.bufferSize);
+    startFile();
+    return true;
+  }
+
+  /* Writes the session preamble to a newly opened fp and opens its index if needed */
+  void startFile() {
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    m_written = size > 0 ? uint64_t(size) : 0;
+    if (!m_block.empty()) {
+      /* Each session restates the format, so appended and rotated files decode on their own */
+      fwrite(blockz::Magic, 1, sizeof(blockz::Magic), fp);
+      fputc(blockz::Version, fp);
+      m_written += sizeof(blockz::Magic) + 1;
+    }
+    /* Raw text appended to a compressed log would break its block framing */
+    if (m_block.empty())
+      AddCrashFile(fp);
+    m_lastFlush = std::chrono::steady_clock::now();
+    if (m_options.rotateInterval)
+      m_nextRotate = std::chrono::system_clock::now() + std::chrono::seconds(m_options.rotateInterval);
+    if (indexing() && (m_indexFp || (m_indexFp = openFile(".idx", "ab")))) {
+      fseek(m_indexFp, 0, SEEK_END);
+      if (ftell(m_indexFp) == 0) {
+        logindex::Header header;
+        memcpy(header.magic, logindex::Magic, sizeof(header.magic));
+        header.version = logindex::Version;
+        header.entrySize = sizeof(logindex::Entry);
+        fwrite(&header, sizeof(header), 1, m_indexFp);
+      }
+    }
+#if !_WIN32
+    if (m_options.rotateSize || m_options.rotateInterval) {
+      std::lock_guard<std::mutex> lk(m_helperMutex);
+      if (!m_helper.joinable())
+        m_helper = std::thread([this]() { helperProc(); });
+      m_wantNext = true;
+      m_helperCond.notify_one();
+    }
+#endif
+  }
+
+  void helperProc() {
+    std::unique_lock<std::mutex> lk(m_helperMutex);
+    for (;;) {
+      m_helperCond.wait(lk, [this]() { return m_helperStop || !m_closing.empty() || (m_wantNext && !m_nextFp); });
+      while (!m_closing.empty()) {
+        ClosingFile closing = std::move(m_closing.back());
+        m_closing.pop_back();
+        lk.unlock();
+        fclose(closing.fp);
+        lk.lock();
+      }
+      if (m_helperStop)
+        return;
+      if (m_wantNext && !m_nextFp) {
+        /* A leftover from an earlier run is truncated; if opening fails, rotate() opens inline */
+        m_wantNext = false;
+        lk.unlock();
+        std::unique_ptr<char[]> buffer(m_options.bufferSize ? new char[m_options.bufferSize] : nullptr);
+        FILE* next = openFile(".next", indexing() ? "wb" : "w");
+        FILE* nextIndex = next && indexing() ? openFile(".next.idx", "wb") : nullptr;
+        if (next && buffer)
+          setvbuf(next, buffer.get(), _IOFBF, m_options.bufferSize);
+        lk.lock();
+        m_nextFp = next;
+        m_nextIndexFp = nextIndex;
+        m_nextBuffer = std::move(buffer);
+      }
+    }
+  }
+
+  /* Closes every rotated-out file and discards the prepared one */
+  void stopHelper() {
+    {
+      std::lock_guard<std::mutex> lk(m_helperMutex);
+      if (!m_helper.joinable())
+        return;
+      m_helperStop = true;
+    }
+    m_helperCond.notify_one();
+    m_helper.join();
+    if (m_nextFp) {
+      fclose(m_nextFp);
+      removeFile(".next");
+    }
+    if (m_nextIndexFp) {
+      fclose(m_nextIndexFp);
+      removeFile(".next.idx");
+    }
+    m_nextFp = m_nextIndexFp = nullptr;
+  }
+
+  /* Compressed output has no stable text offsets to index */
+  bool indexing() const { return m_options.indexInterval && m_block.empty(); }
+
+  /* Adds a record occupying [offset, offset + size) of the log to the current index run */
+  void indexRecord(const LogRecord& record, uint64_t offset, size_t size) {
+    logindex::Entry& run = m_indexRun;
+    if (!run.records) {
+      run = {};
+      run.offset = offset;
+      run.minUptimeNs = run.maxUptimeNs = record.uptimeNs;
+      run.minFrame = run.maxFrame = record.frameIndex;
+    }
+    run.length = offset + size - run.offset;
+    run.minUptimeNs = std::min(run.minUptimeNs, record.uptimeNs);
+    run.maxUptimeNs = std::max(run.maxUptimeNs, record.uptimeNs);
+    run.minFrame = std::min(run.minFrame, record.frameIndex);
+    run.maxFrame = std::max(run.maxFrame, record.frameIndex);
+    run.modules |= logindex::ModuleBit(record.modName);
+    run.severities |= uint8_t(1 << record.severity);
+    ++run.records;
+    if (run.length >= m_options.indexInterval)
+      endIndexRun();
+  }
+
+  void endIndexRun() {
+    if (m_indexFp && m_indexRun.records)
+      fwrite(&m_indexRun, sizeof(m_indexRun), 1, m_indexFp);
+    m_indexRun.records = 0;
+  }
+
+  void closeIndex() {
+    endIndexRun();
+    if (m_indexFp)
+      fclose(m_indexFp);
+    m_indexFp = nullptr;
+  }
+
+  void archiveFile() {
+    char suffix[64];
+    if (m_options.archiveNaming == FileArchiveNaming::Timestamped) {
+      time_t now = time(nullptr);
+      struct tm tmv;
+#if _WIN32
+      localtime_s(&tmv, &now);
+#else
+      localtime_r(&now, &tmv);
+#endif
+      size_t len = strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tmv);
+      /* Disambiguate rotations within the same second */
+      m_sameSecond = now == m_lastSecond ? m_sameSecond + 1 : 0;
+      m_lastSecond = now;
+      if (m_sameSecond)
+        snprintf(suffix + len, sizeof(suffix) - len, "-%u", m_sameSecond);
+      archiveRename("", suffix);
+    } else {
+      unsigned maxArchives = m_options.maxArchives ? m_options.maxArchives : 1;
+      char from[16], to[16];
+      snprintf(to, sizeof(to), ".%u", maxArchives);
+      removeFile(to);
+      if (indexing())
+        removeFile((std::string(to) + ".idx").c_str());
+      for (unsigned i = maxArchives; i > 1; --i) {
+        snprintf(from, sizeof(from), ".%u", i - 1);
+        snprintf(to, sizeof(to), ".%u", i);
+        archiveRename(from, to);
+      }
+      archiveRename("", ".1");
+    }
+  }
+
+  /* Renames a log and its index together */
+  void archiveRename(const char* fromSuffix, const char* toSuffix) {
+    renameFile(fromSuffix, toSuffix);
+    if (indexing())
+      renameFile((std::string(fromSuffix) + ".idx").c_str(), (std::string(toSuffix) + ".idx").c_str());
+  }
+
+  void rotate() {
+    m_written += writeBlock();
+    closeIndex();
+    FILE* oldFp = fp;
+    fp = nullptr;
+    RemoveCrashFile(oldFp);
+#if _WIN32
+    /* Open files can't be renamed on Windows */
+    fclose(oldFp);
+    archiveFile();
+    ensureOpen();
+#else
+    archiveFile();
+    /* The rotated-out stream keeps its buffer until the helper has flushed and closed it */
+    FILE* next;
+    {
+      std::lock_guard<std::mutex> lk(m_helperMutex);
+      m_closing.push_back({oldFp, std::move(m_buffer)});
+      next = std::exchange(m_nextFp, nullptr);
+      m_indexFp = std::exchange(m_nextIndexFp, nullptr);
+      m_buffer = std::move(m_nextBuffer);
+    }
+    m_helperCond.notify_one();
+    if (next && renameFile(".next", "") == 0) {
+      if (m_indexFp && renameFile(".next.idx", ".idx") != 0) {
+        fclose(m_indexFp);
+        m_indexFp = nullptr;
+      }
+      fp = next;
+      startFile();
+      return;
+    }
+    /* Nothing prepared; open inline */
+    if (next)
+      fclose(next);
+    if (m_indexFp)
+      fclose(m_indexFp);
+    m_indexFp = nullptr;
+    if (!m_buffer && m_options.bufferSize)
+      m_buffer.reset(new char[m_options.bufferSize]);
+    ensureOpen();
+#endif
+  }
+
+  bool beginRecord() {
+    if (fp && m_options.rotateInterval && std::chrono::system_clock::now() >= m_nextRotate)
+      rotate();
+    return ensureOpen();
+  }
+
+  /* Compresses and writes the pending block as one frame; returns bytes written */
+  size_t writeBlock() {
+    if (!m_blockLen || !fp)
+      return 0;
+    uint8_t* frame = m_packed.data();
+    size_t packedLen = blockz::Compress(m_block.data(), m_blockLen, frame + blockz::FrameHeaderSize);
+    uint32_t stored = uint32_t(packedLen);
+    if (packedLen >= m_blockLen) {
+      memcpy(frame + blockz::FrameHeaderSize, m_block.data(), m_blockLen);
+      packedLen = m_blockLen;
+      stored = uint32_t(m_blockLen) | blockz::StoredRaw;
+    }
+    blockz::PutLE32(frame, uint32_t(m_blockLen));
+    blockz::PutLE32(frame + 4, stored);
+    fwrite(frame, 1, blockz::FrameHeaderSize + packedLen, fp);
+    m_blockLen = 0;
+    return blockz::FrameHeaderSize + packedLen;
+  }
+
+  /* Writes rendered text directly or through the block compressor; returns bytes that reached the file */
+  size_t writeText(const char* data, size_t size) {
+    if (m_block.empty())
+      return fwrite(data, 1, size, fp);
+    size_t written = 0;
+    while (size) {
+      size_t take = std::min(size, m_block.size() - m_blockLen);
+      memcpy(m_block.data() + m_blockLen, data, take);
+      m_blockLen += take;
+      data += take;
+      size -= take;
+      if (m_blockLen == m_block.size())
+        written += writeBlock();
+    }
+    return written;
+  }
+
+  void endRecord(size_t written, Level severity) {
+    m_written += written;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (severity >= m_options.flushLevel || severity == Fatal || !m_buffer ||
+        (m_options.flushInterval && now - m_lastFlush >= std::chrono::milliseconds(m_options.flushInterval))) {
+      m_written += writeBlock();
+      fflush(fp);
+      if (m_indexFp)
+        fflush(m_indexFp);
+      m_lastFlush = now;
+    }
+    if (m_options.rotateSize && m_written >= m_options.rotateSize)
+      rotate();
+  }
+
+  void flush() {
+    if (fp) {
+      m_written += writeBlock();
+      fflush(fp);
+      if (m_indexFp)
+        fflush(m_indexFp);
+      m_lastFlush = std::chrono::steady_clock::now();
+    }
+  }
+
+  /* Appends one record as a line of output */
+  virtual void render(detail::FormatBuffer& out, const LogRecord& record) {
+    RenderHead(out, PlainStyle, HeadOf(record), record.modName, record.sourceInfo, record.severity);
+    AppendRecordText(out, record);
+    out.append('\n', 1);
+  }
+
+  void write(const LogRecord& record) { writeBatch(&record, 1); }
+
+  /* A batch is written, flushed and rotated as one unit, so it always lands in a single file */
+  void writeBatch(const LogRecord* records, size_t count) {
+    if (!beginRecord())
+      return;
+    detail::FormatBuffer& out = RenderBuffer;
+    out.clear();
+    Level severity = Info;
+    for (size_t i = 0; i < count; ++i) {
+      size_t start = out.size();
+      render(out, records[i]);
+      if (m_indexFp)
+        indexRecord(records[i], m_written + start, out.size() - start);
+      severity = std::max(severity, records[i].severity);
+    }
+    countBytes(out.size());
+    endRecord(writeText(out.data(), out.size()), severity);
+  }
+};
+
+struct FileLogger8 : public FileLogger {
+  std::string m_filepath;
+  FileLogger8(const char* filepath, const FileLoggerOptions& options) : FileLogger(options), m_filepath(filepath) {}
+  ~FileLogger8() { stopHelper(); }
+  FILE* openFile(const char* suffix, const char* mode) { return fopen((m_filepath + suffix).c_str(), mode); }
+  int renameFile(const char* fromSuffix, const char* toSuffix) {
+    return rename((m_filepath + fromSuffix).c_str(), (m_filepath + toSuffix).c_str());
+  }
+  int removeFile(const char* suffix) { return remove((m_filepath + suffix).c_str()); }
+  std::string describe() const { return "file " + m_filepath; }
+};
+
+void RegisterFileLogger(const char* filepath) { RegisterFileLogger(filepath, FileLoggerOptions()); }
+
+void RegisterFileLogger(const char* filepath, const FileLoggerOptions& options) {
+  /* Otherwise construct new file logger */
+  MainLoggers.emplace_back(new FileLogger8(filepath, options));
+}
+
+static void AppendJsonString(detail::FormatBuffer& out, const char* str, size_t len) {
+  static constexpr char Hex[] = "0123456789abcdef";
+  out.append('"', 1);
+  const char* run = str;
+  for (const char* p = str; p < str + len; ++p) {
+    uint8_t c = uint8_t(*p);
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    out.append(run, p - run);
+    run = p + 1;
+    switch (c) {
+    case '"':
+      Append(out, "\\\"");
+      break;
+    case '\\':
+      Append(out, "\\\\");
+      break;
+    case '\n':
+      Append(out, "\\n");
+      break;
+    case '\r':
+      Append(out, "\\r");
+      break;
+    case '\t':
+      Append(out, "\\t");
+      break;
+    default: {
+      char esc[6] = {'\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 0xf]};
+      out.append(esc, sizeof(esc));
+      break;
+    }
+    }
+  }
+  out.append(run, str + len - run);
+  out.append('"', 1);
+}
+
+static void AppendJsonString(detail::FormatBuffer& out, const char* str) {
+  if (str)
+    AppendJsonString(out, str, strlen(str));
+  else
+    Append(out, "null");
+}
+
+static void AppendDecimal(detail::FormatBuffer& out, uint64_t value) {
+  char buf[20];
+  char* begin = detail::FormatDecimal(buf + sizeof(buf), value);
+  out.append(begin, buf + sizeof(buf) - begin);
+}
+
+struct JsonLogger : public FileLogger8 {
+  using FileLogger8::FileLogger8;
+
+  void render(detail::FormatBuffer& out, const LogRecord& record) {
+    Append(out, "{\"uptime_ns\":");
+    AppendDecimal(out, record.uptimeNs);
+    Append(out, ",\"time_ns\":");
+    if (record.wallNs < 0)
+      out.append('-', 1);
+    AppendDecimal(out, record.wallNs < 0 ? uint64_t(-record.wallNs) : uint64_t(record.wallNs));
+    Append(out, ",\"frame\":");
+    AppendDecimal(out, record.frameIndex);
+    Append(out, ",\"severity\":");
+    AppendJsonString(out, PlainStyle.severity[record.severity].data(), PlainStyle.severity[record.severity].size());
+    Append(out, ",\"module\":");
+    AppendJsonString(out, record.modName);
+    Append(out, ",\"thread\":");
+    AppendJsonString(out, record.thread.name);
+    Append(out, ",\"tid\":");
+    AppendDecimal(out, record.thread.osId);
+    if (record.file) {
+      Append(out, ",\"file\":");
+      AppendJsonString(out, record.file);
+      Append(out, ",\"line\":");
+      AppendDecimal(out, record.linenum);
+    }
+    Append(out, ",\"message\":");
+    AppendJsonString(out, record.message.data(), record.message.size());
+    if (record.fieldCount) {
+      Append(out, ",\"fields\":{");
+      for (size_t i = 0; i < record.fieldCount; ++i) {
+        const LogField& field = record.fields[i];
+        if (i)
+          out.append(',', 1);
+        AppendJsonString(out, field.key);
+        out.append(':', 1);
+        if (field.type == LogField::String) {
+          AppendJsonString(out, field.str.data, field.str.size);
+        } else if (field.type == LogField::Pointer) {
+          out.append('"', 1);
+          AppendFieldValue(out, field);
+          out.append('"', 1);
+        } else if (field.type == LogField::Float && !std::isfinite(field.f)) {
+          Append(out, "null");
+        } else {
+          AppendFieldValue(out, field);
+        }
+      }
+      out.append('}', 1);
+    }
+    Append(out, "}\n");
+  }
+
+  std::string describe() const { return "json " + m_filepath; }
+};
+
+void RegisterJsonLogger(const char* filepath, const FileLoggerOptions& options) {
+  MainLoggers.emplace_back(new JsonLogger(filepath, options));
+}
+
+#if LOG_UCS2
+
+struct FileLogger16 : public FileLogger {
+  std::wstring m_filepath;
+  FileLogger16(const wchar_t* filepath, const FileLoggerOptions& options) : FileLogger(options), m_filepath(filepath) {}
+  ~FileLogger16() { stopHelper(); }
+  static std::wstring widenSuffix(const char* suffix) { return std::wstring(suffix, suffix + strlen(suffix)); }
+  FILE* openFile(const char* suffix, const char* mode) {
+    return _wfopen((m_filepath + widenSuffix(suffix)).c_str(), widenSuffix(mode).c_str());
+  }
+  int renameFile(const char* fromSuffix, const char* toSuffix) {
+    return _wrename((m_filepath + widenSuffix(fromSuffix)).c_str(), (m_filepath + widenSuffix(toSuffix)).c_str());
+  }
+  int removeFile(const char* suffix) { return _wremove((m_filepath + widenSuffix(suffix)).c_str()); }
+  std::string describe() const {
+    std::string path(m_filepath.size() * 4, '\0');
+    path.resize(WideToUTF8(path.data(), m_filepath.data(), m_filepath.size()));
+    return "file " + path;
+  }
+};
+
+void RegisterFileLogger(const wchar_t* filepath) { RegisterFileLogger(filepath, FileLoggerOptions()); }
+
+void RegisterFileLogger(const wchar_t* filepath, const FileLoggerOptions& options) {
+  /* Determine if file logger already added */
+  for (ILogger* logger : MainLoggers.snapshot()) {
+    FileLogger16* filelogger = dynamic_cast<FileLogger16*>(logger);
+    if (filelogger) {
+      if (filelogger->m_filepath == filepath)
+        return;
+    }
+  }
+
+  /* Otherwise construct new file logger */
+  MainLoggers.emplace_back(new FileLogger16(filepath, options));
+}
+
+#endif
+
+struct BinaryLogger : public ILogger {
+  struct ArgOp {
+    binlog::ArgClass cls;
+    unsigned size;
+    int precision;
+    bool starWidth;
+    bool starPrecision;
+  };
+  struct FormatEntry {
+    uint64_t id;
+    std::vector<ArgOp> ops;
+  };
+
+  FILE* fp;
+  std::vector<uint8_t> m_buf;
+  size_t m_len = 0;
+  std::unordered_map<const char*, FormatEntry> m_formats;
+  std::unordered_map<const char*, uint64_t> m_modules;
+  std::unordered_map<const char*, uint64_t> m_files;
+  std::unordered_map<const char*, uint64_t> m_threads;
+  uint64_t m_nextId = 1;
+  detail::FormatBuffer m_message;
+
+  std::string m_filepath;
+
+  explicit BinaryLogger(const char* filepath) : m_buf(64 * 1024), m_filepath(filepath) {
+    fp = fopen(filepath, "ab");
+    if (fp) {
+      setvbuf(fp, nullptr, _IONBF, 0);
+      fwrite(binlog::Magic, 1, sizeof(binlog::Magic), fp);
+      fputc(binlog::Version, fp);
+    }
+  }
+  ~BinaryLogger() {
+    if (fp) {
+      flush();
+      fclose(fp);
+    }
+  }
+
+  void flush() {
+    if (m_len && fp)
+      countBytes(fwrite(m_buf.data(), 1, m_len, fp));
+    m_len = 0;
+  }
+
+  std::string describe() const { return "binary " + m_filepath; }
+
+  uint8_t* reserve(size_t count) {
+    if (m_len + count > m_buf.size()) {
+      flush();
+      if (count > m_buf.size())
+        m_buf.resize(count);
+    }
+    return m_buf.data() + m_len;
+  }
+  void commit(uint8_t* end) { m_len = end - m_buf.data(); }
+
+  void putByte(uint8_t b) {
+    uint8_t* out = reserve(1);
+    *out = b;
+    commit(out + 1);
+  }
+  void putVarint(uint64_t v) { commit(binlog::PutVarint(reserve(10), v)); }
+  void putBytes(const void* data, size_t len) {
+    uint8_t* out = reserve(len);
+    memcpy(out, data, len);
+    commit(out + len);
+  }
+  void putString(const char* str, size_t len) {
+    putVarint(len);
+    putBytes(str, len);
+  }
+  void putWideString(const wchar_t* str, size_t len) {
+    /* Worst case 3 UTF-8 bytes per UTF-16 unit or 4 per UTF-32 unit */
+    uint8_t* out = reserve(10 + len * 4);
+    uint8_t* body = out + 10;
+    size_t bodyLen = WideToUTF8((char*)body, str, len);
+    uint8_t* lenEnd = binlog::PutVarint(out, bodyLen);
+    memmove(lenEnd, body, bodyLen);
+    commit(lenEnd + bodyLen);
+  }
+
+  uint64_t intern(std::unordered_map<const char*, uint64_t>& table, binlog::Tag tag, const char* str) {
+    if (!str)
+      return 0;
+    auto search = table.find(str);
+    if (search != table.end())
+      return search->second;
+    uint64_t id = m_nextId++;
+    table[str] = id;
+    putByte(tag);
+    putVarint(id);
+    putString(str, strlen(str));
+    return id;
+  }
+
+  const FormatEntry& internFormat(const char* format) {
+    auto search = m_formats.find(format);
+    if (search != m_formats.end())
+      return search->second;
+    FormatEntry& entry = m_formats[format];
+    entry.id = m_nextId++;
+    const char* p = format;
+    binlog::Spec spec;
+    while (binlog::NextSpec(p, spec))
+      if (spec.cls != binlog::ArgClass::None || spec.starWidth || spec.starPrecision)
+        entry.ops.push_back({spec.cls, spec.size, spec.precision, spec.starWidth, spec.starPrecision});
+    putByte(binlog::TagFormat);
+    putVarint(entry.id);
+    putString(format, strlen(format));
+    return entry;
+  }
+
+  void putHead(binlog::Tag tag, const char* modName, Level severity, const char* file, unsigned linenum,
+               uint64_t formatId) {
+    RecordHead head = CaptureHead();
+    uint64_t modId = intern(m_modules, binlog::TagModule, modName);
+    uint64_t thrId = intern(m_threads, binlog::TagThread, head.thread.name);
+    uint64_t fileId = intern(m_files, binlog::TagFile, file);
+    uint8_t* out = reserve(1 + 1 + 10 * 8);
+    *out++ = tag;
+    *out++ = uint8_t(severity);
+    out = binlog::PutVarint(out, modId);
+    out = binlog::PutVarint(out, formatId);
+    out = binlog::PutVarint(out, head.uptimeNs);
+    out = binlog::PutVarint(out, binlog::ZigZag(head.wallNs));
+    out = binlog::PutVarint(out, head.frameIndex);
+    out = binlog::PutVarint(out, thrId);
+    out = binlog::PutVarint(out, fileId);
+    out = binlog::PutVarint(out, linenum);
+    commit(out);
+  }
+
+  void putArgs(const FormatEntry& entry, va_list ap) {
+    for (const ArgOp& op : entry.ops) {
+      int precision = op.precision;
+      if (op.starWidth)
+        putVarint(binlog::ZigZag(va_arg(ap, int)));
+      if (op.starPrecision) {
+        precision = va_arg(ap, int);
+        putVarint(binlog::ZigZag(precision));
+      }
+      switch (op.cls) {
+      case binlog::ArgClass::Signed: {
+        int64_t v;
+        if (op.size <= sizeof(int))
+          v = va_arg(ap, int);
+        else if (op.size == sizeof(long))
+          v = va_arg(ap, long);
+        else
+          v = va_arg(ap, long long);
+        if (op.size == sizeof(char))
+          v = (signed char)v;
+        else if (op.size == sizeof(short))
+          v = short(v);
+        putVarint(binlog::ZigZag(v));
+        break;
+      }
+      case binlog::ArgClass::Unsigned: {
+        uint64_t v;
+        if (op.size <= sizeof(int))
+          v = va_arg(ap, unsigned);
+        else if (op.size == sizeof(long))
+          v = va_arg(ap, unsigned long);
+        else
+          v = va_arg(ap, unsigned long long);
+        if (op.size == sizeof(char))
+          v = (unsigned char)v;
+        else if (op.size == sizeof(short))
+          v = (unsigned short)v;
+        putVarint(v);
+        break;
+      }
+      case binlog::ArgClass::Double:
+      case binlog::ArgClass::LongDouble: {
+        double v = op.cls == binlog::ArgClass::Double ? va_arg(ap, double) : double(va_arg(ap, long double));
+        putBytes(&v, sizeof(v));
+        break;
+      }
+      case binlog::ArgClass::Pointer:
+        putVarint(uintptr_t(va_arg(ap, void*)));
+        break;
+      case binlog::ArgClass::String: {
+        /* Length is biased by one; zero encodes a null pointer */
+        const char* str = va_arg(ap, const char*);
+        if (!str) {
+          putVarint(0);
+          break;
+        }
+        size_t len = precision >= 0 ? strnlen(str, size_t(precision)) : strlen(str);
+        putVarint(len + 1);
+        putBytes(str, len);
+        break;
+      }
+      case binlog::ArgClass::WideString: {
+        const wchar_t* str = va_arg(ap, const wchar_t*);
+        if (!str) {
+          putVarint(0);
+          break;
+        }
+        size_t len = 0;
+        while (str[len] && (precision < 0 || len < size_t(precision)))
+          ++len;
+        putVarint(1);
+        putWideString(str, len);
+        break;
+      }
+      case binlog::ArgClass::WideChar: {
+        wchar_t ch = wchar_t(va_arg(ap, wint_t));
+        putWideString(&ch, 1);
+        break;
+      }
+      case binlog::ArgClass::Count:
+        va_arg(ap, void*);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  void writeRecord(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                   va_list ap) {
+    if (!fp)
+      return;
+    const FormatEntry& entry = internFormat(format);
+    putHead(binlog::TagRecord, modName, severity, file, linenum, entry.id);
+    putArgs(entry, ap);
+    if (severity >= Error)
+      flush();
+  }
+
+  void writeRecord(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                   va_list ap) {
+    /* Wide formats are rendered up front and stored as UTF-8 text */
+    if (!fp)
+      return;
+    m_message.clear();
+    RenderMessage(m_message, format, ap);
+    putHead(binlog::TagMessage, modName, severity, file, linenum, 0);
+    putString(m_message.data(), m_message.size());
+    if (severity >= Error)
+      flush();
+  }
+
+  void report(const char* modName, Level severity, const char* format, va_list ap) {
+    writeRecord(modName, severity, nullptr, 0, format, ap);
+  }
+
+  void report(const char* modName, Level severity, const wchar_t* format, va_list ap) {
+    writeRecord(modName, severity, nullptr, 0, format, ap);
+  }
+
+  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                    va_list ap) {
+    writeRecord(modName, severity, file, linenum, format, ap);
+  }
+
+  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                    va_list ap) {
+    writeRecord(modName, severity, file, linenum, format, ap);
+  }
+};
+
+void RegisterBinaryLogger(const char* filepath) { MainLoggers.emplace_back(new BinaryLogger(filepath)); }
+
+struct MappedLogger : public LogSink {
+  std::string m_prefix;
+  MappedLoggerOptions m_options;
+  unsigned m_index = 0;
+  unsigned m_oldest = 0; /* Lowest segment index that may still be on disk */
+  uint8_t* m_base = nullptr;
+  size_t m_offset = 0;
+#if _WIN32
+  HANDLE m_file = INVALID_HANDLE_VALUE;
+  HANDLE m_mapping = nullptr;
+#else
+  int m_fd = -1;
+#endif
+
+  MappedLogger(const char* pathPrefix, const MappedLoggerOptions& options) : m_prefix(pathPrefix), m_options(options) {
+    m_options.segmentSize = std::max(m_options.segmentSize, size_t(4096));
+    scanSegments();
+  }
+  ~MappedLogger() { closeSegment(); }
+
+  std::string segmentPath(unsigned index) const {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%06u", index);
+    return m_prefix + suffix;
+  }
+
+  /* Continues numbering after the highest segment left by earlier runs, which need not
+   * start at 1 once old segments have been pruned */
+  void scanSegments() {
+    std::filesystem::path prefix(m_prefix);
+    std::filesystem::path dir = prefix.parent_path();
+    std::string base = prefix.filename().string() + '.';
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir.empty() ? "." : dir, ec)) {
+      std::string name = entry.path().filename().string();
+      if (name.size() <= base.size() || name.compare(0, base.size(), base) != 0 ||
+          name.find_first_not_of("0123456789", base.size()) != std::string::npos)
+        continue;
+      unsigned index = unsigned(strtoul(name.c_str() + base.size(), nullptr, 10));
+      m_index = std::max(m_index, index);
+      if (index && (!m_oldest || index < m_oldest))
+        m_oldest = index;
+    }
+    if (!m_oldest)
+      m_oldest = m_index + 1;
+  }
+
+  /* Removes every segment at or below m_index - maxSegments */
+  void pruneSegments() {
+    if (!m_options.maxSegments)
+      return;
+    for (; m_oldest + m_options.maxSegments <= m_index; ++m_oldest)
+      remove(segmentPath(m_oldest).c_str());
+  }
+
+  bool openSegment() {
+    /* Never reuse a name: a segment that appeared since the scan is skipped, not overwritten */
+    std::string path;
+    size_t size = m_options.segmentSize;
+#if _WIN32
+    do {
+      path = segmentPath(++m_index);
+      m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_NEW,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    } while (m_file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_FILE_EXISTS);
+    if (m_file == INVALID_HANDLE_VALUE)
+      return false;
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+    if (m_mapping)
+      m_base = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size);
+    if (!m_base) {
+      if (m_mapping)
+        CloseHandle(m_mapping);
+      CloseHandle(m_file);
+      m_mapping = nullptr;
+      m_file = INVALID_HANDLE_VALUE;
+      return false;
+    }
+#else
+    do {
+      path = segmentPath(++m_index);
+      m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    } while (m_fd < 0 && errno == EEXIST);
+    if (m_fd < 0)
+      return false;
+#if __linux__
+    /* Reserve blocks up front so a full disk fails here rather than as SIGBUS on a store */
+    bool sized = posix_fallocate(m_fd, 0, off_t(size)) == 0;
+#else
+    bool sized = ftruncate(m_fd, off_t(size)) == 0;
+#endif
+    void* base = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0) : MAP_FAILED;
+    if (base == MAP_FAILED) {
+      ::close(m_fd);
+      unlink(path.c_str());
+      m_fd = -1;
+      return false;
+    }
+    m_base = (uint8_t*)base;
+#endif
+    seglog::Header header;
+    memcpy(header.magic, seglog::Magic, sizeof(header.magic));
+    header.version = seglog::Version;
+    header.index = m_index;
+    memcpy(m_base, &header, sizeof(header));
+    m_offset = sizeof(header);
+
+    pruneSegments();
+    return true;
+  }
+
+  /* Unmaps the current segment and trims the unused preallocation */
+  void closeSegment() {
+    if (!m_base)
+      return;
+    size_t used = std::min(m_offset, m_options.segmentSize);
+#if _WIN32
+    UnmapViewOfFile(m_base);
+    CloseHandle(m_mapping);
+    LARGE_INTEGER length;
+    length.QuadPart = LONGLONG(used);
+    if (SetFilePointerEx(m_file, length, nullptr, FILE_BEGIN))
+      SetEndOfFile(m_file);
+    CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    munmap(m_base, m_options.segmentSize);
+    if (ftruncate(m_fd, off_t(used)) != 0) {
+      /* The zero-filled tail reads as end of segment, so leaving it is harmless */
+    }
+    ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_base = nullptr;
+  }
+
+  /* Claims space for a record, rolling to a new segment when the current one is full.
+   * Sinks are written under the log lock, which serializes the cursor. */
+  uint8_t* reserve(size_t recordSize) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+      if (!m_base && !openSegment())
+        return nullptr;
+      if (m_offset + recordSize <= m_options.segmentSize) {
+        uint8_t* rec = m_base + m_offset;
+        m_offset += recordSize;
+        return rec;
+      }
+      closeSegment();
+    }
+    return nullptr;
+  }
+
+  void flush() {
+#if _WIN32
+    if (m_base)
+      FlushViewOfFile(m_base, 0);
+#else
+    if (m_base)
+      msync(m_base, m_options.segmentSize, MS_ASYNC);
+#endif
+  }
+
+  void write(const LogRecord& record) {
+    detail::FormatBuffer& out = RenderBuffer;
+    out.clear();
+    RenderHead(out, PlainStyle, HeadOf(record), record.modName, record.sourceInfo, record.severity);
+    AppendRecordText(out, record);
+    /* Records larger than a segment are cut short to fit */
+    size_t textLen = std::min(out.size(), m_options.segmentSize - sizeof(seglog::Header) - seglog::RecordSize(1));
+    uint32_t len = uint32_t(textLen + 1);
+    uint8_t* rec = reserve(seglog::RecordSize(len));
+    if (!rec)
+      return;
+    seglog::BeginRecord(rec, len);
+    memcpy(rec + sizeof(uint32_t), out.data(), textLen);
+    rec[sizeof(uint32_t) + textLen] = '\n';
+    seglog::CommitRecord(rec, len);
+    countBytes(len);
+  }
+
+  std::string describe() const { return "mapped " + m_prefix; }
+};
+
+void RegisterMappedLogger(const char* pathPrefix, const MappedLoggerOptions& options) {
+  MainLoggers.emplace_back(new MappedLogger(pathPrefix, options));
+}
+
+#if !_WIN32
+/* Text safe for a syslog header field or structured-data name: printable ASCII without
+ * spaces, capped at maxLen; anything else becomes '_'. Empty text is the nil value. */
+static void AppendSyslogToken(detail::FormatBuffer& out, const char* str, size_t maxLen, bool sdName = false) {
+  if (!str || !*str) {
+    out.append('-', 1);
+    return;
+  }
+  for (size_t i = 0; str[i] && i < maxLen; ++i) {
+    char c = str[i];
+    bool bad = c <= ' ' || c > '~' || (sdName && (c == '=' || c == ']' || c == '"'));
+    out.append(bad ? '_' : c, 1);
+  }
+}
+
+static void AppendSyslogParam(detail::FormatBuffer& out, const char* name, const char* value, size_t len) {
+  out.append(' ', 1);
+  AppendSyslogToken(out, name, 32, true);
+  Append(out, "=\"");
+  const char* end = value + len;
+  for (const char* run = value; value <= end; ++value) {
+    if (value < end && *value != '"' && *value != '\\' && *value != ']')
+      continue;
+    out.append(run, value - run);
+    if (value < end)
+      out.append('\\', 1);
+    run = value;
+  }
+  out.append('"', 1);
+}
+
+/* journald field names are uppercase letters, digits and underscores, starting with a letter */
+static void AppendJournalName(detail::FormatBuffer& out, const char* name) {
+  size_t len = 0;
+  if (!(*name >= 'A' && *name <= 'Z') && !(*name >= 'a' && *name <= 'z')) {
+    out.append('F', 1);
+    ++len;
+  }
+  for (; *name && len < 64; ++name, ++len) {
+    char c = *name;
+    if (c >= 'a' && c <= 'z')
+      c = char(c - 'a' + 'A');
+    else if (!(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9'))
+      c = '_';
+    out.append(c, 1);
+  }
+}
+
+/* Values containing a newline use the binary form: name, newline, little-endian 64-bit length, data */
+static void AppendJournalValue(detail::FormatBuffer& out, const char* value, size_t len) {
+  if (!memchr(value, '\n', len)) {
+    out.append('=', 1);
+    out.append(value, len);
+  } else {
+    out.append('\n', 1);
+    char size[8];
+    for (int i = 0; i < 8; ++i)
+      size[i] = char(uint64_t(len) >> (i * 8));
+    out.append(size, sizeof(size));
+    out.append(value, len);
+  }
+  out.append('\n', 1);
+}
+
+static void AppendJournalField(detail::FormatBuffer& out, const char* name, std::string_view value) {
+  Append(out, name);
+  AppendJournalValue(out, value.data(), value.size());
+}
+
+static void AppendJournalField(detail::FormatBuffer& out, const char* name, uint64_t value) {
+  Append(out, name);
+  out.append('=', 1);
+  AppendDecimal(out, value);
+  out.append('\n', 1);
+}
+
+/* Local collector sink. Reporters render records into m_pending under the log lock; the
+ * sender thread swaps the queue out and sends it in batches, so connecting, a slow
+ * collector or its restart only ever stall the sender. */
+struct SocketLogger : public LogSink {
+  struct Queue {
+    std::vector<char> text;
+    std::vector<std::pair<size_t, size_t>> messages; /* Offset and length into text */
+  };
+
+  std::string m_path;
+  SocketLoggerOptions m_options;
+  std::string m_appName;
+  std::string m_hostname;
+  uint64_t m_pid;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_drained;
+  Queue m_pending;       /* Guarded by m_mutex, as is everything up to m_sender */
+  size_t m_inFlight = 0; /* Records the sender has taken but not yet sent */
+  size_t m_dropped = 0;  /* Records refused at capacity since the last warning */
+  bool m_connected = false;
+  bool m_urgent = false;
+  bool m_stop = false;
+  detail::FormatBuffer m_value; /* Non-string field values while rendering */
+  std::thread m_sender;
+
+  /* Owned by the sender thread */
+  Queue m_working;
+  size_t m_sent = 0;        /* Records of m_working already sent */
+  size_t m_partialSent = 0; /* Bytes of the next record already written to a stream */
+  int m_fd = -1;
+
+  SocketLogger(const char* socketPath, const SocketLoggerOptions& options)
+  : m_path(socketPath), m_options(options), m_pid(uint64_t(getpid())) {
+    m_options.maxBatch = std::clamp(m_options.maxBatch, size_t(1), size_t(1024));
+    m_options.queueCapacity = std::max(m_options.queueCapacity, m_options.maxBatch);
+    if (options.appName)
+      m_appName = options.appName;
+#if __linux__
+    else
+      m_appName = program_invocation_short_name;
+#elif __APPLE__ || __FreeBSD__
+    else
+      m_appName = getprogname();
+#endif
+    char hostname[256] = {};
+    if (gethostname(hostname, sizeof(hostname) - 1) == 0)
+      m_hostname = hostname;
+    m_connected = connect();
+    m_sender = std::thread(&SocketLogger::senderProc, this);
+  }
+
+  ~SocketLogger() {
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_sender.join();
+    if (m_fd >= 0)
+      ::close(m_fd);
+  }
+
+  bool connect() {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (m_path.size() >= sizeof(addr.sun_path))
+      return false;
+    memcpy(addr.sun_path, m_path.c_str(), m_path.size() + 1);
+    int fd = socket(AF_UNIX, m_options.type == SocketType::Stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+    if (fd < 0)
+      return false;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+      ::close(fd);
+      return false;
+    }
+    /* A collector that stops reading must not hold the sender forever */
+    timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    m_fd = fd;
+    m_partialSent = 0;
+    return true;
+  }
+
+  void disconnect() {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+
+  /* Sends up to maxBatch queued records; returns how many were completed, or -1 on error */
+  ssize_t sendBatch() {
+    size_t count = std::min(m_working.messages.size() - m_sent, m_options.maxBatch);
+    iovec iov[1024];
+    for (size_t i = 0; i < count; ++i) {
+      auto [offset, len] = m_working.messages[m_sent + i];
+      iov[i].iov_base = m_working.text.data() + offset;
+      iov[i].iov_len = len;
+    }
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+    if (m_options.type == SocketType::Stream) {
+      iov[0].iov_base = (char*)iov[0].iov_base + m_partialSent;
+      iov[0].iov_len -= m_partialSent;
+      msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = int(count);
+      ssize_t written = sendmsg(m_fd, &msg, flags);
+      if (written < 0)
+        return -1;
+      countBytes(size_t(written));
+      size_t done = 0;
+      size_t left = size_t(written);
+      for (; done < count && left >= iov[done].iov_len; ++done)
+        left -= iov[done].iov_len;
+      m_partialSent = done ? left : m_partialSent + left;
+      return ssize_t(done);
+    }
+#if __linux__
+    mmsghdr msgs[1024];
+    for (size_t i = 0; i < count; ++i) {
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sendmmsg(m_fd, msgs, unsigned(count), flags);
+    if (sent < 0)
+      return errno == EMSGSIZE ? 1 : -1; /* Drop a record too large for one datagram */
+    for (int i = 0; i < sent; ++i)
+      countBytes(msgs[i].msg_len);
+    return sent;
+#else
+    for (size_t i = 0; i < count; ++i) {
+      ssize_t sent = send(m_fd, iov[i].iov_base, iov[i].iov_len, flags);
+      if (sent < 0) {
+        if (errno == EMSGSIZE)
+          continue;
+        return i ? ssize_t(i) : -1;
+      }
+      countBytes(size_t(sent));
+    }
+    return ssize_t(count);
+#endif
+  }
+
+  void senderProc() {
+    RegisterThreadName("logvisor socket");
+    std::unique_lock<std::mutex> lk(m_mutex);
+    for (;;) {
+      if (m_sent == m_working.messages.size()) {
+        m_working.text.clear();
+        m_working.messages.clear();
+        m_sent = 0;
+        if (!m_stop && !m_urgent && m_options.batchInterval) {
+          /* The first record starts the batch interval */
+          m_wake.wait(lk, [&] { return m_stop || !m_pending.messages.empty(); });
+          m_wake.wait_for(lk, std::chrono::milliseconds(m_options.batchInterval), [&] { return m_stop || m_urgent; });
+        } else if (!m_stop) {
+          m_wake.wait(lk, [&] { return m_stop || !m_pending.messages.empty(); });
+        }
+        m_urgent = false;
+        std::swap(m_pending, m_working);
+        m_inFlight = m_working.messages.size();
+      }
+      bool stopping = m_stop;
+      lk.unlock();
+
+      bool connected = m_fd >= 0 || connect();
+      while (connected && m_sent < m_working.messages.size()) {
+        ssize_t done = sendBatch();
+        if (done < 0) {
+          /* The collector went away; records it didn't take are sent again after reconnecting */
+          disconnect();
+          m_partialSent = 0;
+          connected = false;
+        } else {
+          m_sent += size_t(done);
+        }
+      }
+
+      lk.lock();
+      m_connected = connected;
+      m_inFlight = m_working.messages.size() - m_sent;
+      m_drained.notify_all();
+      if (stopping && (!connected || m_pending.messages.empty()))
+        break;
+      if (!connected)
+        m_wake.wait_for(lk, std::chrono::milliseconds(m_options.reconnectInterval), [&] { return m_stop; });
+    }
+  }
+
+  void renderSyslog(detail::FormatBuffer& out, const LogRecord& record) {
+    static const unsigned SeverityCodes[] = {6, 4, 3, 2}; /* informational, warning, error, critical */
+    out.append('<', 1);
+    AppendDecimal(out, m_options.facility * 8 + SeverityCodes[record.severity]);
+    Append(out, ">1 ");
+    int64_t second = record.wallNs / 1000000000;
+    int64_t subNs = record.wallNs % 1000000000;
+    if (subNs < 0) {
+      subNs += 1000000000;
+      --second;
+    }
+    time_t t = time_t(second);
+    struct tm tmv;
+    gmtime_r(&t, &tmv);
+    char stamp[40];
+    size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tmv);
+    len += snprintf(stamp + len, sizeof(stamp) - len, ".%06uZ ", unsigned(subNs / 1000));
+    out.append(stamp, len);
+    AppendSyslogToken(out, m_hostname.c_str(), 255);
+    out.append(' ', 1);
+    AppendSyslogToken(out, m_appName.c_str(), 48);
+    out.append(' ', 1);
+    AppendDecimal(out, m_pid);
+    out.append(' ', 1);
+    AppendSyslogToken(out, record.modName, 32);
+    /* 32473 is the enterprise number reserved for examples (RFC 5612) */
+    Append(out, " [logvisor@32473");
+    char number[24];
+    int numberLen = snprintf(number, sizeof(number), "%" PRIu64, record.thread.osId);
+    AppendSyslogParam(out, "tid", number, size_t(numberLen));
+    if (record.thread.name)
+      AppendSyslogParam(out, "thread", record.thread.name, strlen(record.thread.name));
+    if (record.file) {
+      AppendSyslogParam(out, "file", record.file, strlen(record.file));
+      numberLen = snprintf(number, sizeof(number), "%u", record.linenum);
+      AppendSyslogParam(out, "line", number, size_t(numberLen));
+    }
+    for (size_t i = 0; i < record.fieldCount; ++i) {
+      const LogField& field = record.fields[i];
+      if (field.type == LogField::String) {
+        AppendSyslogParam(out, field.key, field.str.data, field.str.size);
+      } else {
+        m_value.clear();
+        AppendFieldValue(m_value, field);
+        AppendSyslogParam(out, field.key, m_value.data(), m_value.size());
+      }
+    }
+    Append(out, "] ");
+    Append(out, record.message);
+  }
+
+  void renderJournald(detail::FormatBuffer& out, const LogRecord& record) {
+    static const unsigned SeverityCodes[] = {6, 4, 3, 2};
+    AppendJournalField(out, "MESSAGE", record.message);
+    AppendJournalField(out, "PRIORITY", uint64_t(SeverityCodes[record.severity]));
+    AppendJournalField(out, "SYSLOG_FACILITY", uint64_t(m_options.facility));
+    if (!m_appName.empty())
+      AppendJournalField(out, "SYSLOG_IDENTIFIER", m_appName);
+    AppendJournalField(out, "LOGVISOR_MODULE", record.modName);
+    if (record.file) {
+      AppendJournalField(out, "CODE_FILE", record.file);
+      AppendJournalField(out, "CODE_LINE", uint64_t(record.linenum));
+    }
+    AppendJournalField(out, "TID", record.thread.osId);
+    if (record.thread.name)
+      AppendJournalField(out, "LOGVISOR_THREAD", record.thread.name);
+    AppendJournalField(out, "LOGVISOR_UPTIME_NS", record.uptimeNs);
+    AppendJournalField(out, "LOGVISOR_FRAME", record.frameIndex);
+    for (size_t i = 0; i < record.fieldCount; ++i) {
+      const LogField& field = record.fields[i];
+      AppendJournalName(out, field.key);
+      if (field.type == LogField::String) {
+        AppendJournalValue(out, field.str.data, field.str.size);
+      } else {
+        m_value.clear();
+        AppendFieldValue(m_value, field);
+        AppendJournalValue(out, m_value.data(), m_value.size());
+      }
+    }
+  }
+
+  void write(const LogRecord& record) { writeBatch(&record, 1); }
+
+  void writeBatch(const LogRecord* records, size_t count) {
+    detail::FormatBuffer& out = RenderBuffer;
+    bool stream = m_options.type == SocketType::Stream;
+    std::unique_lock<std::mutex> lk(m_mutex);
+    bool wasEmpty = m_pending.messages.empty();
+    /* Records the sender holds count against the capacity too */
+    size_t held = std::min(m_pending.messages.size() + m_inFlight, m_options.queueCapacity);
+    size_t accepted = std::min(count, m_options.queueCapacity - held);
+    m_dropped += count - accepted;
+    for (size_t i = 0; i < accepted; ++i) {
+      out.clear();
+      if (m_options.protocol == SocketProtocol::Syslog) {
+        if (stream)
+          out.append(' ', 1); /* Follows the octet count prepended below */
+        renderSyslog(out, records[i]);
+      } else {
+        renderJournald(out, records[i]);
+        if (stream)
+          out.append('\n', 1);
+      }
+      size_t offset = m_pending.text.size();
+      if (stream && m_options.protocol == SocketProtocol::Syslog) {
+        char count[24];
+        int countLen = snprintf(count, sizeof(count), "%zu", out.size() - 1);
+        m_pending.text.insert(m_pending.text.end(), count, count + countLen);
+      }
+      m_pending.text.insert(m_pending.text.end(), out.data(), out.data() + out.size());
+      m_pending.messages.emplace_back(offset, m_pending.text.size() - offset);
+      if (records[i].severity >= Error)
+        m_urgent = true;
+    }
+    if (m_pending.messages.size() >= m_options.maxBatch || !m_options.batchInterval)
+      m_urgent = true;
+    bool wake = m_urgent || wasEmpty;
+    /* Drops are summarized once the queue has room again; the warning is delivered here as well */
+    size_t dropped = accepted == count ? std::exchange(m_dropped, 0) : 0;
+    lk.unlock();
+    if (wake)
+      m_wake.notify_one();
+    if (dropped)
+      Log.report(Warning, "%" PRIuPTR " log records dropped while collector %s was unreachable", uintptr_t(dropped),
+                 m_path.c_str());
+  }
+
+  /* Waits for everything queued so far to reach the collector, unless it is unreachable */
+  void flush() {
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (m_pending.messages.empty() && !m_inFlight)
+      return;
+    m_urgent = true;
+    m_wake.notify_one();
+    m_drained.wait_for(lk, std::chrono::seconds(1),
+                       [&] { return !m_connected || (m_pending.messages.empty() && !m_inFlight); });
+  }
+
+  std::string describe() const {
+    return (m_options.protocol == SocketProtocol::Syslog ? "syslog " : "journald ") + m_path;
+  }
+};
+
+void RegisterSocketLogger(const char* socketPath, const SocketLoggerOptions& options) {
+  MainLoggers.emplace_back(new SocketLogger(socketPath, options));
+}
+
+/* Shared-memory ring logger; the layout and protocol are described in shmring.hpp */
+struct RingLogger : public LogSink {
+  std::string m_name;
+  shmring::Header* m_header = nullptr;
+  size_t m_mapSize = 0;
+
+  RingLogger(const char* name, size_t capacity) : m_name(name) {
+    capacity = std::bit_ceil(std::max(capacity, size_t(64 * 1024)));
+    /* A collector still draining a previous ring keeps its own mapping */
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+      return;
+    m_mapSize = sizeof(shmring::Header) + capacity;
+    void* base = ftruncate(fd, off_t(m_mapSize)) == 0
+                     ? mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+    ::close(fd);
+    if (base == MAP_FAILED) {
+      shm_unlink(name);
+      return;
+    }
+    m_header = (shmring::Header*)base;
+    memcpy(m_header->magic, shmring::Magic, sizeof(shmring::Magic));
+    m_header->version = shmring::Version;
+    m_header->capacity = capacity;
+    m_header->producerPid = uint64_t(getpid());
+    m_header->producerStart = shmring::ProcessStartTime(m_header->producerPid);
+    m_header->state.store(shmring::Open, std::memory_order_release);
+  }
+
+  ~RingLogger() {
+    if (!m_header)
+      return;
+    m_header->state.store(shmring::Closed, std::memory_order_release);
+    munmap(m_header, m_mapSize);
+  }
+
+  void write(const LogRecord& record) {
+    if (!m_header)
+      return;
+    detail::FormatBuffer& message = RenderBuffer;
+    message.clear();
+    Append(message, record.message);
+    AppendFieldText(message, record.fields, record.fieldCount);
+
+    shmring::Record rec = {};
+    rec.uptimeNs = record.uptimeNs;
+    rec.wallNs = record.wallNs;
+    rec.frameIndex = record.frameIndex;
+    rec.threadId = record.thread.osId;
+    rec.linenum = record.linenum;
+    rec.severity = uint8_t(record.severity);
+    rec.moduleLen = uint16_t(std::min(strlen(record.modName), size_t(UINT16_MAX)));
+    rec.threadNameLen = record.thread.name ? uint16_t(std::min(strlen(record.thread.name), size_t(UINT16_MAX))) : 0;
+    rec.fileLen = record.file ? uint16_t(std::min(strlen(record.file), size_t(UINT16_MAX))) : 0;
+    /* Records larger than a quarter of the ring are cut short to fit */
+    size_t capacity = m_header->capacity;
+    size_t fixedLen = sizeof(rec) + rec.moduleLen + rec.threadNameLen + rec.fileLen;
+    rec.messageLen = uint32_t(std::min(message.size(), capacity / 4 - std::min(capacity / 4, fixedLen + 8)));
+    size_t size = shmring::RecordSize(fixedLen + rec.messageLen);
+    if (size > capacity / 4) {
+      m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    uint64_t write = m_header->write.load(std::memory_order_relaxed);
+    uint64_t read = m_header->read.load(std::memory_order_acquire);
+    size_t offset = size_t(write & (capacity - 1));
+    size_t pad = capacity - offset < size ? capacity - offset : 0;
+    if (write + pad + size - read > capacity) {
+      m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    uint8_t* data = shmring::Data(m_header);
+    if (pad) {
+      memcpy(data + offset, &shmring::PadMarker, sizeof(uint32_t));
+      offset = 0;
+    }
+    uint8_t* out = data + offset;
+    uint32_t len = uint32_t(fixedLen + rec.messageLen);
+    memcpy(out, &len, sizeof(len));
+    out += sizeof(len);
+    memcpy(out, &rec, sizeof(rec));
+    out += sizeof(rec);
+    memcpy(out, record.modName, rec.moduleLen);
+    out += rec.moduleLen;
+    if (rec.threadNameLen)
+      memcpy(out, record.thread.name, rec.threadNameLen);
+    out += rec.threadNameLen;
+    if (rec.fileLen)
+      memcpy(out, record.file, rec.fileLen);
+    out += rec.fileLen;
+    memcpy(out, message.data(), rec.messageLen);
+    m_header->write.store(write + pad + size, std::memory_order_release);
+    countBytes(size);
+  }
+
+  std::string describe() const { return "ring " + m_name; }
+};
+
+void RegisterRingLogger(const char* name, size_t capacity) { MainLoggers.emplace_back(new RingLogger(name, capacity)); }
+
+#if LOGVISOR_HAS_IO_URING
+/* Just enough of io_uring for the file logger, driven by raw system calls so no
+ * liburing is needed. The submission and completion rings are shared with the
+ * kernel; each side only advances its own cursor. */
+struct IoUring {
+  int fd = -1;
+  unsigned entries = 0;
+  void* sqMap = MAP_FAILED;
+  size_t sqMapSize = 0;
+  void* cqMap = MAP_FAILED;
+  size_t cqMapSize = 0;
+  io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+  size_t sqesSize = 0;
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqArray;
+  unsigned sqMask;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  io_uring_cqe* cqes;
+  unsigned cqMask;
+
+  bool init(unsigned depth) {
+    io_uring_params params = {};
+    fd = int(syscall(__NR_io_uring_setup, depth, &params));
+    if (fd < 0)
+      return false;
+    entries = params.sq_entries;
+    sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+    sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqMap == MAP_FAILED)
+      return false;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      cqMap = sqMap;
+    else if ((cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING)) == MAP_FAILED)
+      return false;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                               IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      return false;
+    char* sq = (char*)sqMap;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    char* cq = (char*)cqMap;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    return true;
+  }
+
+  ~IoUring() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqesSize);
+    if (cqMap != MAP_FAILED && cqMap != sqMap)
+      munmap(cqMap, cqMapSize);
+    if (sqMap != MAP_FAILED)
+      munmap(sqMap, sqMapSize);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  int registerBuffers(const iovec* iovs, unsigned count) {
+    return int(syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iovs, count));
+  }
+
+  /* Returns a cleared entry, published to the kernel at once, or null if the ring is full */
+  io_uring_sqe* nextSqe() {
+    unsigned tail = *sqTail;
+    if (tail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire) >= entries)
+      return nullptr;
+    unsigned index = tail & sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    return sqe;
+  }
+
+  /* Publishes an entry filled in after nextSqe() */
+  void push() { std::atomic_ref<unsigned>(*sqTail).fetch_add(1, std::memory_order_release); }
+
+  /* Submits every published entry and waits for minComplete completions; -errno on failure */
+  int enter(unsigned minComplete) {
+    unsigned count = *sqTail - std::atomic_ref<unsigned>(*sqHead).load(std::memory_order_acquire);
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    return syscall(__NR_io_uring_enter, fd, count, minComplete, flags, nullptr, 0) < 0 ? -errno : 0;
+  }
+
+  /* Calls f(cqe) for each completion posted so far */
+  template <typename Func>
+  void reap(Func f) {
+    unsigned head = *cqHead;
+    unsigned tail = std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire);
+    for (unsigned i = head; i != tail; ++i)
+      f(cqes[i & cqMask]);
+    std::atomic_ref<unsigned>(*cqHead).store(tail, std::memory_order_release);
+  }
+};
+#endif
+
+/* File logger whose writes complete off the reporting thread. Text is rendered into a
+ * fixed pool of aligned buffers; a full one is queued at its file offset and reporting
+ * carries on in the next. A writer thread issues queued buffers through io_uring, keeping
+ * up to queueDepth writes in flight, or writes them one at a time with pwrite() where
+ * io_uring is unavailable. io_uring cancels a request when the thread that submitted it
+ * exits, so reporting threads never submit anything themselves. Every write names its
+ * offset, so writes may complete in any order. With O_DIRECT a partial block is written
+ * zero-padded and again once more text arrives; the second write is held back until
+ * nothing else is in flight. */
+struct UringLogger : public LogSink {
+  static constexpr size_t Alignment = 4096; /* O_DIRECT granularity of offsets, lengths and addresses */
+
+  struct Buffer {
+    char* data = nullptr;
+    unsigned index = 0;
+    size_t len = 0;      /* Bytes of text */
+    size_t done = 0;     /* Bytes already written before a short write */
+    uint64_t offset = 0; /* File offset of data[0] */
+    bool drain = false;  /* Rewrites a block that an earlier write may still hold */
+    iovec iov;
+  };
+
+  std::string m_path;
+  UringLoggerOptions m_options;
+  int m_fd = -1;
+  bool m_direct = false;
+  std::unique_ptr<Buffer[]> m_buffers;
+  unsigned m_bufferCount = 0;
+  std::vector<Buffer*> m_free;
+  Buffer* m_current = nullptr;
+  bool m_pending = false;  /* m_current holds text not yet queued */
+  unsigned m_inFlight = 0; /* Buffers queued and not yet returned */
+  std::chrono::steady_clock::time_point m_lastSubmit;
+
+#if LOGVISOR_HAS_IO_URING
+  IoUring m_ring;
+  bool m_useRing = false;
+  bool m_fixed = false;
+  int m_wakeFd = -1; /* eventfd the writer polls through the ring alongside its writes */
+#endif
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_written;
+  std::vector<Buffer*> m_queue; /* Guarded by m_mutex, as is everything up to m_writer */
+  std::vector<Buffer*> m_completed;
+  bool m_stop = false;
+  std::thread m_writer;
+
+  UringLogger(const char* filepath, const UringLoggerOptions& options) : m_path(filepath), m_options(options) {
+    m_options.queueDepth = std::clamp(m_options.queueDepth, 1u, 256u);
+    m_options.bufferSize = std::max((m_options.bufferSize + Alignment - 1) & ~(Alignment - 1), Alignment);
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+#ifdef O_DIRECT
+    /* File systems without direct I/O refuse it at open */
+    if (m_options.directIO && (m_fd = open(filepath, flags | O_DIRECT, 0644)) >= 0)
+      m_direct = true;
+#endif
+    if (m_fd < 0 && (m_fd = open(filepath, flags, 0644)) < 0)
+      return;
+    struct stat st;
+    uint64_t size = fstat(m_fd, &st) == 0 ? uint64_t(st.st_size) : 0;
+
+    /* One buffer filling and one spare besides those in flight */
+    m_bufferCount = m_options.queueDepth + 2;
+    m_buffers.reset(new Buffer[m_bufferCount]);
+    for (unsigned i = 0; i < m_bufferCount; ++i) {
+      Buffer& buf = m_buffers[i];
+      if (!(buf.data = (char*)aligned_alloc(Alignment, m_options.bufferSize))) {
+        /* Left inactive without a writer; the destructor frees what was allocated */
+        ::close(m_fd);
+        m_fd = -1;
+        return;
+      }
+      buf.index = i;
+      m_free.push_back(&buf);
+    }
+    m_current = takeBuffer();
+    size_t tail = m_direct ? size_t(size & (Alignment - 1)) : 0;
+    if (tail && pread(m_fd, m_current->data, Alignment, off_t(size - tail)) < ssize_t(tail)) {
+      /* The existing partial block can't be read back to be rewritten; append without direct I/O */
+      ::close(m_fd);
+      m_direct = false;
+      if ((m_fd = open(filepath, flags, 0644)) < 0)
+        return;
+    }
+    startBuffer(m_current, size);
+    m_lastSubmit = std::chrono::steady_clock::now();
+
+#if LOGVISOR_HAS_IO_URING
+    /* One more entry for the writer's poll of the eventfd */
+    if (m_options.useIoUring && (m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) >= 0 &&
+        m_ring.init(m_options.queueDepth + 1)) {
+      m_useRing = true;
+      if (m_options.registerBuffers) {
+        std::vector<iovec> iovs(m_bufferCount);
+        for (unsigned i = 0; i < m_bufferCount; ++i)
+          iovs[i] = {m_buffers[i].data, m_options.bufferSize};
+        /* Fails when the pool exceeds RLIMIT_MEMLOCK on older kernels; writes then pin pages per call */
+        m_fixed = m_ring.registerBuffers(iovs.data(), m_bufferCount) == 0;
+      }
+      m_writer = std::thread(&UringLogger::ringProc, this);
+      return;
+    }
+#endif
+    m_writer = std::thread(&UringLogger::writerProc, this);
+  }
+
+  ~UringLogger() {
+    if (m_writer.joinable()) {
+      flush();
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+      }
+      wakeWriter();
+      m_writer.join();
+    }
+    if (m_fd >= 0) {
+      /* Drops the zero padding past the end of the text */
+      if (m_direct) {
+        [[maybe_unused]] int ret = ftruncate(m_fd, off_t(m_current->offset + m_current->len));
+      }
+      ::close(m_fd);
+    }
+#if LOGVISOR_HAS_IO_URING
+    if (m_wakeFd >= 0)
+      ::close(m_wakeFd);
+#endif
+    for (unsigned i = 0; i < m_bufferCount; ++i)
+      free(m_buffers[i].data);
+  }
+
+  bool usingRing() const {
+#if LOGVISOR_HAS_IO_URING
+    return m_useRing;
+#else
+    return false;
+#endif
+  }
+
+  /* Begins filling buf at file offset end; with direct I/O the buffer starts at the enclosing
+   * block, whose text the caller must place in it */
+  void startBuffer(Buffer* buf, uint64_t end) {
+    buf->offset = m_direct ? end & ~uint64_t(Alignment - 1) : end;
+    buf->len = size_t(end - buf->offset);
+    buf->done = 0;
+    buf->drain = false;
+  }
+
+  size_t writeLength(const Buffer& buf) const {
+    return m_direct ? (buf.len + Alignment - 1) & ~(Alignment - 1) : buf.len;
+  }
+
+  void wakeWriter() {
+#if LOGVISOR_HAS_IO_URING
+    if (m_useRing) {
+      eventfd_write(m_wakeFd, 1);
+      return;
+    }
+#endif
+    m_wake.notify_one();
+  }
+
+  /* Reporting side, under the log lock. The pool holds queueDepth + 2 buffers and every
+   * queued one comes back through complete(), even after a failed write, so an empty
+   * pool always has a buffer in flight to wait for */
+  Buffer* takeBuffer() {
+    while (m_free.empty())
+      reap(true);
+    Buffer* buf = m_free.back();
+    m_free.pop_back();
+    return buf;
+  }
+
+  /* Zeroes the rest of the last block written with direct I/O */
+  void padTail(Buffer* buf) {
+    size_t len = writeLength(*buf);
+    if (len > buf->len)
+      memset(buf->data + buf->len, 0, len - buf->len);
+  }
+
+  void queue(Buffer* buf) {
+    padTail(buf);
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_queue.push_back(buf);
+      ++m_inFlight;
+    }
+    wakeWriter();
+  }
+
+  /* Returns written buffers to the pool, optionally waiting for at least one */
+  void reap(bool wait) {
+    if (!m_inFlight)
+      return;
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (wait)
+      m_written.wait(lk, [&] { return !m_completed.empty(); });
+    m_inFlight -= unsigned(m_completed.size());
+    m_free.insert(m_free.end(), m_completed.begin(), m_completed.end());
+    m_completed.clear();
+  }
+
+  void waitIdle() {
+    while (m_inFlight)
+      reap(true);
+  }
+
+  /* Queues the text gathered so far and continues in a fresh buffer */
+  void submitCurrent() {
+    if (!m_pending)
+      return;
+    Buffer* buf = m_current;
+    uint64_t end = buf->offset + buf->len;
+    queue(buf);
+    reap(false);
+    m_current = takeBuffer();
+    startBuffer(m_current, end);
+    if (m_current->len) {
+      /* The partial last block is carried over and written again after the write just queued */
+      memcpy(m_current->data, buf->data + (m_current->offset - buf->offset), m_current->len);
+      m_current->drain = true;
+    }
+    m_pending = false;
+    m_lastSubmit = std::chrono::steady_clock::now();
+  }
+
+  void append(const char* data, size_t size) {
+    while (size) {
+      size_t take = std::min(size, m_options.bufferSize - m_current->len);
+      memcpy(m_current->data + m_current->len, data, take);
+      m_current->len += take;
+      m_pending = true;
+      data += take;
+      size -= take;
+      if (m_current->len == m_options.bufferSize)
+        submitCurrent();
+    }
+  }
+
+  /* Writer side */
+  void complete(std::vector<Buffer*>& done) {
+    if (done.empty())
+      return;
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_completed.insert(m_completed.end(), done.begin(), done.end());
+    }
+    m_written.notify_one();
+    done.clear();
+  }
+
+  void writeNow(Buffer* buf) {
+    size_t len = writeLength(*buf);
+    while (buf->done < len) {
+      ssize_t ret = pwrite(m_fd, buf->data + buf->done, len - buf->done, off_t(buf->offset + buf->done));
+      if (ret < 0 && errno == EINTR)
+        continue;
+      if (ret <= 0)
+        break;
+      buf->done += size_t(ret);
+    }
+  }
+
+  void writerProc() {
+    RegisterThreadName("logvisor file writer");
+    std::vector<Buffer*> batch;
+    std::unique_lock<std::mutex> lk(m_mutex);
+    for (;;) {
+      m_wake.wait(lk, [&] { return m_stop || !m_queue.empty(); });
+      if (m_queue.empty())
+        break;
+      batch.swap(m_queue);
+      lk.unlock();
+      for (Buffer* buf : batch)
+        writeNow(buf);
+      complete(batch);
+      lk.lock();
+    }
+  }
+
+#if LOGVISOR_HAS_IO_URING
+  void prepWrite(io_uring_sqe* sqe, Buffer* buf) {
+    buf->iov = {buf->data + buf->done, writeLength(*buf) - buf->done};
+    sqe->fd = m_fd;
+    sqe->off = buf->offset + buf->done;
+    if (m_fixed) {
+      sqe->opcode = IORING_OP_WRITE_FIXED;
+      sqe->addr = uint64_t(uintptr_t(buf->iov.iov_base));
+      sqe->len = unsigned(buf->iov.iov_len);
+      sqe->buf_index = uint16_t(buf->index);
+    } else {
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->addr = uint64_t(uintptr_t(&buf->iov));
+      sqe->len = 1;
+    }
+    sqe->user_data = uint64_t(uintptr_t(buf));
+  }
+
+  void ringProc() {
+    RegisterThreadName("logvisor io_uring");
+    std::vector<Buffer*> waiting;   /* Queued buffers not yet submitted, in file order */
+    std::vector<Buffer*> submitted; /* Writes in flight */
+    std::vector<Buffer*> done;
+    bool armed = false; /* Poll of m_wakeFd in flight */
+    bool failed = false;
+    for (;;) {
+      bool stop;
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        waiting.insert(waiting.end(), m_queue.begin(), m_queue.end());
+        m_queue.clear();
+        stop = m_stop;
+      }
+      if (failed) {
+        /* The ring stopped accepting work; write everything directly from here on */
+        for (Buffer* buf : waiting)
+          writeNow(buf);
+        complete(waiting);
+        if (stop)
+          break;
+        pollfd pfd = {m_wakeFd, POLLIN, 0};
+        poll(&pfd, 1, -1);
+        eventfd_t value;
+        eventfd_read(m_wakeFd, &value);
+        continue;
+      }
+      if (stop && waiting.empty() && submitted.empty())
+        break;
+
+      io_uring_sqe* sqe;
+      if (!armed && (sqe = m_ring.nextSqe())) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = m_wakeFd;
+        sqe->poll_events = POLLIN;
+        m_ring.push();
+        armed = true;
+      }
+      size_t taken = 0;
+      while (taken < waiting.size() && submitted.size() < m_options.queueDepth &&
+             !(waiting[taken]->drain && !submitted.empty()) && (sqe = m_ring.nextSqe())) {
+        prepWrite(sqe, waiting[taken]);
+        m_ring.push();
+        submitted.push_back(waiting[taken++]);
+      }
+      waiting.erase(waiting.begin(), waiting.begin() + ptrdiff_t(taken));
+
+      int ret = m_ring.enter(1);
+      if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+        /* Whatever was submitted may never complete; write it again directly, as whole buffers */
+        for (Buffer* buf : submitted)
+          buf->done = 0;
+        waiting.insert(waiting.begin(), submitted.begin(), submitted.end());
+        submitted.clear();
+        failed = true;
+        continue;
+      }
+      m_ring.reap([&](const io_uring_cqe& cqe) {
+        if (!cqe.user_data) {
+          eventfd_t value;
+          eventfd_read(m_wakeFd, &value);
+          armed = false;
+          return;
+        }
+        Buffer* buf = (Buffer*)uintptr_t(cqe.user_data);
+        submitted.erase(std::find(submitted.begin(), submitted.end(), buf));
+        bool shortWrite = cqe.res > 0 && buf->done + size_t(cqe.res) < writeLength(*buf);
+        if (cqe.res == -EAGAIN || cqe.res == -EINTR || shortWrite) {
+          /* Write the rest ahead of anything queued since */
+          if (cqe.res > 0)
+            buf->done += size_t(cqe.res);
+          waiting.insert(waiting.begin(), buf);
+        } else {
+          done.push_back(buf);
+        }
+      });
+      complete(done);
+    }
+  }
+#endif
+
+  void write(const LogRecord& record) { writeBatch(&record, 1); }
+
+  void writeBatch(const LogRecord* records, size_t count) {
+    if (!m_writer.joinable())
+      return;
+    detail::FormatBuffer& out = RenderBuffer;
+    out.clear();
+    Level severity = Info;
+    for (size_t i = 0; i < count; ++i) {
+      RenderHead(out, PlainStyle, HeadOf(records[i]), records[i].modName, records[i].sourceInfo, records[i].severity);
+      AppendRecordText(out, records[i]);
+      out.append('\n', 1);
+      severity = std::max(severity, records[i].severity);
+    }
+    countBytes(out.size());
+    append(out.data(), out.size());
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (severity >= m_options.flushLevel || severity == Fatal ||
+        (m_options.flushInterval && now - m_lastSubmit >= std::chrono::milliseconds(m_options.flushInterval)))
+      submitCurrent();
+    /* The process may not outlive a fatal record */
+    if (severity == Fatal)
+      waitIdle();
+  }
+
+  /* Waits until everything reported so far has been written */
+  void flush() {
+    if (!m_writer.joinable())
+      return;
+    submitCurrent();
+    waitIdle();
+  }
+
+  std::string describe() const { return (usingRing() ? "io_uring file " : "threaded file ") + m_path; }
+};
+
+void RegisterUringLogger(const char* filepath, const UringLoggerOptions& options) {
+  MainLoggers.emplace_back(new UringLogger(filepath, options));
+}
+#else
+void RegisterSocketLogger(const char* socketPath, const SocketLoggerOptions& options) {}
+void RegisterRingLogger(const char* name, size_t capacity) {}
+void RegisterUringLogger(const char* filepath, const UringLoggerOptions& options) {}
+#endif
+
+/* Module registry. Modules link themselves into an intrusive list when constructed,
+ * including before main(), so level patterns reach them from any translation unit. */
+struct LevelPattern {
+  std::string glob;
+  Level level;
+};
+
+static std::mutex ModuleRegistryMutex;
+static Module* ModuleListHead = nullptr;
+static std::vector<LevelPattern> ModulePatterns;
+static bool ModulePatternsLoaded = false;
+
+static bool MatchGlob(const char* glob, const char* name) {
+  const char* starGlob = nullptr;
+  const char* starName = nullptr;
+  while (*name) {
+    if (*glob == '*') {
+      starGlob = ++glob;
+      starName = name;
+    } else if (*glob == '?' || *glob == *name) {
+      ++glob;
+      ++name;
+    } else if (starGlob) {
+      glob = starGlob;
+      name = ++starName;
+    } else {
+      return false;
+    }
+  }
+  while (*glob == '*')
+    ++glob;
+  return !*glob;
+}
+
+static bool ParseLevelName(std::string_view name, Level& level) {
+  auto is = [&](std::string_view ref) {
+    return name.size() == ref.size() && std::equal(name.begin(), name.end(), ref.begin(), [](char a, char b) {
+             return tolower((unsigned char)a) == b;
+           });
+  };
+  if (is("info"))
+    level = Info;
+  else if (is("warning") || is("warn"))
+    level = Warning;
+  else if (is("error"))
+    level = Error;
+  else if (is("fatal"))
+    level = Fatal;
+  else
+    return false;
+  return true;
+}
+
+static std::string_view TrimSpace(std::string_view str) {
+  while (!str.empty() && isspace((unsigned char)str.front()))
+    str.remove_prefix(1);
+  while (!str.empty() && isspace((unsigned char)str.back()))
+    str.remove_suffix(1);
+  return str;
+}
+
+/* Appends each well-formed entry to out; returns false if any entry was malformed */
+static bool ParseLevelPatterns(const char* text, std::vector<LevelPattern>& out) {
+  bool ok = true;
+  std::string_view rest(text ? text : "");
+  while (!rest.empty()) {
+    size_t end = rest.find_first_of(",;\n#");
+    std::string_view entry = rest.substr(0, end);
+    if (end == std::string_view::npos) {
+      rest = {};
+    } else if (rest[end] == '#') {
+      size_t eol = rest.find('\n', end);
+      rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+    } else {
+      rest.remove_prefix(end + 1);
+    }
+    entry = TrimSpace(entry);
+    if (entry.empty())
+      continue;
+    size_t eq = entry.rfind('=');
+    bool bare = eq == std::string_view::npos;
+    std::string_view glob = bare ? std::string_view("*") : TrimSpace(entry.substr(0, eq));
+    Level level;
+    if (glob.empty() || !ParseLevelName(bare ? entry : TrimSpace(entry.substr(eq + 1)), level)) {
+      ok = false;
+      continue;
+    }
+    out.push_back({std::string(glob), level});
+  }
+  return ok;
+}
+
+/* Caller holds ModuleRegistryMutex */
+static void ApplyLevelPatterns(Module& mod, bool& patternLevel) {
+  const LevelPattern* match = nullptr;
+  for (const LevelPattern& pattern : ModulePatterns)
+    if (MatchGlob(pattern.glob.c_str(), mod.name()))
+      match = &pattern;
+  if (match) {
+    mod.setLevel(match->level);
+    patternLevel = true;
+  } else if (patternLevel) {
+    mod.setLevel(Info);
+    patternLevel = false;
+  }
+}
+
+void _RegisterModule(Module& mod) {
+  std::lock_guard<std::mutex> lk(ModuleRegistryMutex);
+  if (!ModulePatternsLoaded) {
+    ModulePatternsLoaded = true;
+    ParseLevelPatterns(getenv("LOGVISOR_LEVELS"), ModulePatterns);
+  }
+  mod.m_nextModule = ModuleListHead;
+  if (ModuleListHead)
+    ModuleListHead->m_prevModule = &mod;
+  ModuleListHead = &mod;
+  if (!ModulePatterns.empty())
+    ApplyLevelPatterns(mod, mod.m_patternLevel);
+}
+
+void _UnregisterModule(Module& mod) {
+  std::lock_guard<std::mutex> lk(ModuleRegistryMutex);
+  if (mod.m_prevModule)
+    mod.m_prevModule->m_nextModule = mod.m_nextModule;
+  else if (ModuleListHead == &mod)
+    ModuleListHead = mod.m_nextModule;
+  if (mod.m_nextModule)
+    mod.m_nextModule->m_prevModule = mod.m_prevModule;
+  mod.m_prevModule = mod.m_nextModule = nullptr;
+}
+
+bool SetModuleLevels(const char* patterns) {
+  std::vector<LevelPattern> parsed;
+  bool ok = ParseLevelPatterns(patterns, parsed);
+  std::lock_guard<std::mutex> lk(ModuleRegistryMutex);
+  ModulePatternsLoaded = true;
+  ModulePatterns = std::move(parsed);
+  for (Module* mod = ModuleListHead; mod; mod = mod->m_nextModule)
+    ApplyLevelPatterns(*mod, mod->m_patternLevel);
+  return ok;
+}
+
+/* Level file watching: the file is reread every poll and reapplied when its contents change */
+static std::thread LevelWatcher;
+static std::mutex LevelWatchMutex;
+static std::atomic_bool LevelWatchRunning(false);
+static volatile sig_atomic_t LevelReloadRequested = 0;
+
+static void LevelReloadHandler(int) { LevelReloadRequested = 1; }
+
+static bool ReadLevelFile(const std::string& path, std::string& text) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+  text.clear();
+  char chunk[4096];
+  size_t readSz;
+  while ((readSz = fread(chunk, 1, sizeof(chunk), fp)))
+    text.append(chunk, readSz);
+  fclose(fp);
+  return true;
+}
+
+static void ApplyLevelFile(const std::string& path, const std::string& text) {
+  if (!SetModuleLevels(text.c_str()))
+    Log.report(Warning, "malformed entries in module level file %s were ignored", path.c_str());
+}
+
+static void LevelWatchProc(std::string path, unsigned pollMs, std::string applied) {
+  RegisterThreadName("logvisor level watch");
+  std::chrono::steady_clock::time_point nextPoll = std::chrono::steady_clock::now();
+  while (LevelWatchRunning.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(pollMs, 50u)));
+    bool forced = LevelReloadRequested;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!forced && now < nextPoll)
+      continue;
+    LevelReloadRequested = 0;
+    nextPoll = now + std::chrono::milliseconds(pollMs);
+    std::string text;
+    if (ReadLevelFile(path, text) && (forced || text != applied)) {
+      ApplyLevelFile(path, text);
+      applied = std::move(text);
+    }
+  }
+}
+
+bool WatchModuleLevels(const char* path, unsigned pollMs, int reloadSignal) {
+  StopWatchingModuleLevels();
+  std::lock_guard<std::mutex> lk(LevelWatchMutex);
+  static bool registeredExit = false;
+  if (!registeredExit) {
+    atexit(StopWatchingModuleLevels);
+    registeredExit = true;
+  }
+  std::string text;
+  bool ok = ReadLevelFile(path, text);
+  if (ok)
+    ApplyLevelFile(path, text);
+  if (reloadSignal)
+    signal(reloadSignal, LevelReloadHandler);
+  LevelWatchRunning.store(true);
+  LevelWatcher = std::thread(LevelWatchProc, std::string(path), std::max(pollMs, 1u), std::move(text));
+  return ok;
+}
+
+void StopWatchingModuleLevels() {
+  std::lock_guard<std::mutex> lk(LevelWatchMutex);
+  LevelWatchRunning.store(false);
+  if (LevelWatcher.joinable())
+    LevelWatcher.join();
+}
+
+/* Call-site suppression. Sites keyed by format address live in a fixed open-addressed
+ * table; a site that can't be placed within a few probes is left unlimited. */
+static constexpr size_t SiteTableSize = 4096;
+static constexpr size_t SiteTableProbes = 16;
+
+struct SiteSlot {
+  std::atomic<const void*> key{nullptr};
+  LogSite site;
+};
+static SiteSlot SiteTable[SiteTableSize];
+
+LogSite* _SiteForKey(const void* key) {
+  size_t hash = size_t((uint64_t(uintptr_t(key)) * 0x9E3779B97F4A7C15ull) >> 40);
+  for (size_t probe = 0; probe < SiteTableProbes; ++probe) {
+    SiteSlot& slot = SiteTable[(hash + probe) & (SiteTableSize - 1)];
+    const void* cur = slot.key.load(std::memory_order_acquire);
+    if (cur == key)
+      return &slot.site;
+    if (!cur && (slot.key.compare_exchange_strong(cur, key) || cur == key))
+      return &slot.site;
+  }
+  return nullptr;
+}
+
+/* Summaries are delivered directly under the site's module name, so they are never suppressed
+ * themselves and don't construct (and register) a Module per summary */
+static void ReportSiteSummary(const LogSite& site, const char* format, ...) {
+  const char* modName = site.modName.load(std::memory_order_relaxed);
+  Level severity = std::min(site.severity.load(std::memory_order_relaxed), Warning);
+  va_list ap;
+  va_start(ap, format);
+  if (!_AsyncLogging.load(std::memory_order_relaxed) ||
+      !_ReportAsync(modName ? modName : "logvisor", severity, nullptr, 0, format, ap))
+    _ReportSync(modName ? modName : "logvisor", severity, nullptr, 0, format, ap);
+  va_end(ap);
+}
+
+/* Collapse runs are tracked per thread: any other report the thread delivers ends its run.
+ * Sites holding repeats or rate-limited reports are also queued globally so FlushLog()
+ * and exit can summarize sites whose thread went quiet or exited. */
+static thread_local LogSite* LastCollapseSite = nullptr;
+static thread_local bool CollapseSiteReporting = false;
+static std::mutex PendingSummaryMutex;
+static std::vector<LogSite*> PendingSummarySites;
+
+static void FlushSiteSummary(LogSite* site) {
+  if (uint64_t dropped = site->suppressed.exchange(0)) {
+    const char* format = site->format.load(std::memory_order_relaxed);
+    if (site->policy.load(std::memory_order_relaxed) == SitePolicy::PerSecond)
+      ReportSiteSummary(*site, "%" PRIu64 " reports suppressed by rate limit%s%s", dropped, format ? ": " : "",
+                        format ? format : "");
+    else
+      ReportSiteSummary(*site, "last message repeated %" PRIu64 " times%s%s", dropped, format ? ": " : "",
+                        format ? format : "");
+  }
+}
+
+static void FlushSiteSummaries() {
+  std::vector<LogSite*> sites;
+  {
+    std::lock_guard<std::mutex> lk(PendingSummaryMutex);
+    sites.swap(PendingSummarySites);
+  }
+  for (LogSite* site : sites) {
+    site->pending.store(false);
+    FlushSiteSummary(site);
+  }
+}
+
+/* Runs on a thread of its own: by the time atexit handlers run, the exiting thread's
+ * thread_local buffers have already been destroyed */
+static void FlushSiteSummariesAtExit() { std::thread(FlushSiteSummaries).join(); }
+
+static void QueueSiteSummary(LogSite& site) {
+  if (site.pending.exchange(true))
+    return;
+  std::lock_guard<std::mutex> lk(PendingSummaryMutex);
+  static bool registeredExit = false;
+  if (!registeredExit) {
+    atexit(FlushSiteSummariesAtExit);
+    registeredExit = true;
+  }
+  PendingSummarySites.push_back(&site);
+}
+
+/* Called once for every report the thread delivers, before it is delivered */
+static void NoteDeliveredReport() {
+  if (CollapseSiteReporting) {
+    CollapseSiteReporting = false;
+    return;
+  }
+  if (LogSite* site = LastCollapseSite) {
+    LastCollapseSite = nullptr;
+    FlushSiteSummary(site);
+  }
+}
+
+template <typename CharType>
+static bool AdmitSite(LogSite& site, const SitePolicy& policy, const char* modName, Level severity,
+                      const CharType* format) {
+  auto noteSuppressed = [&]() {
+    site.modName.store(modName, std::memory_order_relaxed);
+    site.severity.store(severity, std::memory_order_relaxed);
+    site.policy.store(policy.kind, std::memory_order_relaxed);
+    site.format.store(std::is_same_v<CharType, char> ? (const char*)format : nullptr, std::memory_order_relaxed);
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    CurrentStats.get().suppressed.add(1);
+  };
+
+  switch (policy.kind) {
+  case SitePolicy::PerSecond: {
+    uint64_t now = CurrentUptimeNs() / 1000000000 + 1;
+    uint64_t window = site.window.load(std::memory_order_relaxed);
+    if (window != now && site.window.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+      site.count.store(0, std::memory_order_relaxed);
+      FlushSiteSummary(&site);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) < policy.n)
+      return true;
+    noteSuppressed();
+    QueueSiteSummary(site);
+    return false;
+  }
+  case SitePolicy::Sample:
+    if (site.count.fetch_add(1, std::memory_order_relaxed) % (policy.n ? policy.n : 1) == 0)
+      return true;
+    CurrentStats.get().suppressed.add(1);
+    return false;
+  case SitePolicy::Collapse:
+    if (LastCollapseSite == &site) {
+      noteSuppressed();
+      QueueSiteSummary(site);
+      return false;
+    }
+    NoteDeliveredReport();
+    LastCollapseSite = &site;
+    CollapseSiteReporting = true;
+    return true;
+  default:
+    return true;
+  }
+}
+
+bool _AdmitSite(LogSite& site, const SitePolicy& policy, const char* modName, Level severity, const char* format) {
+  return AdmitSite(site, policy, modName, severity, format);
+}
+
+bool _AdmitSite(LogSite& site, const SitePolicy& policy, const char* modName, Level severity,
+                const wchar_t* format) {
+  return AdmitSite(site, policy, modName, severity, format);
+}
+
+/* Asynchronous logging: a bounded queue of sequence-numbered cells, filled by
+ * reporting threads and drained by a single writer thread. Any thread may also
+ * consume from it to drop the oldest record or to drain ahead of a Fatal report. */
+static constexpr size_t AsyncMessageSize = 1024;
+
+struct AsyncRecord {
+  RecordHead head;
+  const char* modName;
+  const char* file;
+  unsigned linenum;
+  Level severity;
+  bool oversized; /* Message didn't fit; the producer delivers it synchronously instead */
+  char message[AsyncMessageSize];
+};
+
+struct AsyncCell {
+  std::atomic_size_t sequence;
+  AsyncRecord record;
+};
+
+struct AsyncQueue {
+  std::unique_ptr<AsyncCell[]> cells;
+  size_t mask;
+  AsyncOverflow overflow;
+  alignas(64) std::atomic_size_t enqueuePos{0};
+  alignas(64) std::atomic_size_t dequeuePos{0};
+  alignas(64) std::atomic_size_t dropped{0};
+
+  AsyncQueue(size_t capacity, AsyncOverflow overflow) : overflow(overflow) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    cells.reset(new AsyncCell[size]);
+    mask = size - 1;
+    for (size_t i = 0; i < size; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /* Reserves the next free cell for writing; publish() must follow */
+  AsyncCell* claim(size_t& pos) {
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      AsyncCell* cell = &cells[pos & mask];
+      intptr_t diff = intptr_t(cell->sequence.load(std::memory_order_acquire)) - intptr_t(pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          return cell;
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  void publish(AsyncCell* cell, size_t pos) { cell->sequence.store(pos + 1, std::memory_order_release); }
+
+  /* Takes the oldest published cell for reading; release() must follow */
+  AsyncCell* take(size_t& pos) {
+    pos = dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+      AsyncCell* cell = &cells[pos & mask];
+      intptr_t diff = intptr_t(cell->sequence.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          return cell;
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  void release(AsyncCell* cell, size_t pos) { cell->sequence.store(pos + mask + 1, std::memory_order_release); }
+};
+
+std::atomic_bool _AsyncLogging(false);
+static std::unique_ptr<AsyncQueue> AsyncLogQueue;
+static std::thread AsyncWriter;
+static std::atomic_bool AsyncWriterRunning(false);
+static std::atomic_bool AsyncWriterSleeping(false);
+static std::atomic_size_t AsyncProducers(0);
+static std::mutex AsyncWakeMutex;
+static std::condition_variable AsyncWakeCond;
+static thread_local bool InAsyncWriter = false;
+
+static void ReplayMessage(const AsyncRecord& rec, const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  DeliverReport(rec.modName, rec.severity, rec.file, rec.linenum, nullptr, 0, format, ap);
+  va_end(ap);
+}
+
+/* Caller must hold the log lock */
+static void ReplayRecord(const AsyncRecord& rec) {
+  if (rec.oversized)
+    return;
+  ReplayHead = &rec.head;
+  _LogCounter.fetch_add(1, std::memory_order_relaxed);
+  ReplayMessage(rec, "%s", rec.message);
+  ReplayHead = nullptr;
+}
+
+/* Caller must hold the log lock; returns number of records delivered */
+static size_t DrainAsyncQueue(AsyncQueue& queue, size_t maxRecords) {
+  size_t count = 0;
+  size_t pos;
+  while (count < maxRecords) {
+    AsyncCell* cell = queue.take(pos);
+    if (!cell)
+      break;
+    ReplayRecord(cell->record);
+    queue.release(cell, pos);
+    ++count;
+  }
+  if (size_t dropped = queue.dropped.exchange(0))
+    Log.report(Warning, "%" PRIuPTR " log records dropped by asynchronous queue overflow", uintptr_t(dropped));
+  return count;
+}
+
+/* The last producer to leave after DisableAsyncLogging() wakes it */
+static void LeaveAsyncProducer() {
+  if (AsyncProducers.fetch_sub(1) == 1 && !_AsyncLogging.load()) {
+    std::lock_guard<std::mutex> wlk(AsyncWakeMutex);
+    AsyncWakeCond.notify_all();
+  }
+}
+
+static void AsyncWriterProc() {
+  InAsyncWriter = true;
+  RegisterThreadName("logvisor writer");
+  AsyncQueue& queue = *AsyncLogQueue;
+  while (AsyncWriterRunning.load()) {
+    /* Never block on the log lock; a Fatal report may hold it until exit joins this thread */
+    size_t count = 0;
+    {
+      std::unique_lock<std::recursive_mutex> lk(_LogMutex.mutex, std::try_to_lock);
+      if (lk.owns_lock())
+        count = DrainAsyncQueue(queue, 256);
+    }
+    if (count)
+      continue;
+    std::unique_lock<std::mutex> wlk(AsyncWakeMutex);
+    AsyncWriterSleeping.store(true);
+    if (AsyncWriterRunning.load())
+      AsyncWakeCond.wait_for(wlk, std::chrono::milliseconds(5));
+    AsyncWriterSleeping.store(false);
+  }
+}
+
+/* Returns false if the message doesn't fit in a record; ap is left for the caller to reuse */
+template <typename CharType>
+static bool FormatAsyncMessage(AsyncRecord& rec, const CharType* format, va_list ap);
+
+template <>
+bool FormatAsyncMessage(AsyncRecord& rec, const char* format, va_list ap) {
+  va_list apc;
+  va_copy(apc, ap);
+  int len = vsnprintf(rec.message, AsyncMessageSize, format, apc);
+  va_end(apc);
+  if (len < 0)
+    rec.message[0] = '\0';
+  return len < int(AsyncMessageSize);
+}
+
+template <>
+bool FormatAsyncMessage(AsyncRecord& rec, const wchar_t* format, va_list ap) {
+  /* Transcoded here so the writer replays wide records as plain UTF-8 */
+  detail::ScopedFormatBuffer buf;
+  RenderMessage(*buf, format, ap);
+  if (buf->size() >= AsyncMessageSize)
+    return false;
+  memcpy(rec.message, buf->data(), buf->size());
+  rec.message[buf->size()] = '\0';
+  return true;
+}
+
+template <typename CharType>
+static bool ReportAsync(const char* modName, Level severity, const char* file, unsigned linenum,
+                        const CharType* format, va_list ap) {
+  if (InAsyncWriter)
+    return false;
+  AsyncProducers.fetch_add(1);
+  if (!_AsyncLogging.load()) {
+    LeaveAsyncProducer();
+    return false;
+  }
+  NoteDeliveredReport();
+
+  AsyncQueue& queue = *AsyncLogQueue;
+  size_t pos;
+  AsyncCell* cell;
+  while (!(cell = queue.claim(pos))) {
+    if (queue.overflow == AsyncOverflow::DropNewest) {
+      queue.dropped.fetch_add(1);
+      CurrentStats.get().asyncDropped.add(1);
+      LeaveAsyncProducer();
+      return true;
+    } else if (queue.overflow == AsyncOverflow::DropOldest) {
+      size_t oldPos;
+      if (AsyncCell* old = queue.take(oldPos)) {
+        bool oversized = old->record.oversized;
+        queue.release(old, oldPos);
+        if (!oversized) {
+          queue.dropped.fetch_add(1);
+          CurrentStats.get().asyncDropped.add(1);
+        }
+      }
+    } else {
+      /* Drain inline if the lock is free (or already ours) instead of waiting on the writer */
+      std::unique_lock<std::recursive_mutex> lk(_LogMutex.mutex, std::try_to_lock);
+      if (lk.owns_lock()) {
+        DrainAsyncQueue(queue, 256);
+      } else {
+        AsyncWakeCond.notify_one();
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  AsyncRecord& rec = cell->record;
+  rec.head = CaptureHead();
+  rec.modName = modName;
+  rec.file = file;
+  rec.linenum = linenum;
+  rec.severity = severity;
+  rec.oversized = !FormatAsyncMessage(rec, format, ap);
+  if (rec.oversized) {
+    /* Published as a hole so the slot is reused; the synchronous fallback drains ahead of
+     * itself, keeps queue order, and notes the report for collapse runs again */
+    queue.publish(cell, pos);
+    LeaveAsyncProducer();
+    CollapseSiteReporting = true;
+    return false;
+  }
+  if (FlightEnabled(severity))
+    RecordFlightText(modName, severity, rec.message);
+  queue.publish(cell, pos);
+  LeaveAsyncProducer();
+  CountQueuedReport(modName, severity);
+
+  if (AsyncWriterSleeping.load(std::memory_order_relaxed))
+    AsyncWakeCond.notify_one();
+  return true;
+}
+
+bool _ReportAsync(const char* modName, Level severity, const char* file, unsigned linenum, const char* format,
+                  va_list ap) {
+  return ReportAsync(modName, severity, file, linenum, format, ap);
+}
+
+bool _ReportAsync(const char* modName, Level severity, const char* file, unsigned linenum, const wchar_t* format,
+                  va_list ap) {
+  return ReportAsync(modName, severity, file, linenum, format, ap);
+}
+
+void EnableAsyncLogging(size_t capacity, AsyncOverflow overflow) {
+  auto lk = LockLog();
+  if (_AsyncLogging.load() || AsyncWriter.joinable())
+    return;
+  static bool registeredExit = false;
+  if (!registeredExit) {
+    atexit(DisableAsyncLogging);
+    registeredExit = true;
+  }
+  AsyncLogQueue.reset(new AsyncQueue(capacity, overflow));
+  AsyncWriterRunning.store(true);
+  AsyncWriter = std::thread(AsyncWriterProc);
+  _AsyncLogging.store(true);
+}
+
+void DisableAsyncLogging() {
+  if (!_AsyncLogging.exchange(false))
+    return;
+  /* Writer keeps draining while in-flight producers finish */
+  {
+    std::unique_lock<std::mutex> wlk(AsyncWakeMutex);
+    AsyncWakeCond.wait(wlk, [] { return !AsyncProducers.load(); });
+    AsyncWriterRunning.store(false);
+  }
+  AsyncWakeCond.notify_one();
+  if (AsyncWriter.joinable())
+    AsyncWriter.join();
+  auto lk = LockLog();
+  DrainAsyncQueue(*AsyncLogQueue, SIZE_MAX);
+}
+
+/* Frame batching. Each thread appends rendered records to a buffer of its own; a flush
+ * swaps every buffer out, merges the records by timestamp and passes each sink the whole
+ * frame as one batch. Buffers of exited threads are delivered once more and then freed. */
+struct FrameEntry {
+  RecordHead head;
+  const char* modName;
+  const char* file;
+  unsigned linenum;
+  Level severity;
+  size_t message;     /* Offset into text */
+  size_t messageLen;
+  size_t sourceInfo;  /* Offset into text, or SIZE_MAX */
+  size_t fields;      /* First of fieldCount entries in fields */
+  size_t fieldCount;
+};
+
+struct FrameContents {
+  std::vector<FrameEntry> entries;
+  std::vector<char> text;
+  std::vector<LogField> fields; /* Keys and string values hold offsets into text until delivery */
+};
+
+struct FrameBuffer {
+  std::mutex mutex; /* Taken by the owning thread per report, and by flushes */
+  FrameContents contents;
+  bool orphaned = false; /* Guarded by FrameBuffersMutex */
+};
+
+static std::atomic_bool FrameBatching(false);
+static std::atomic_size_t FrameBatchLimit(1024 * 1024);
+/* Set by the first report buffered after a flush; later reports only read it */
+static std::atomic_bool FramePending(false);
+static std::mutex FrameBuffersMutex;
+static std::vector<FrameBuffer*> FrameBuffers;
+
+struct ThreadFrame {
+  FrameBuffer* buffer = nullptr;
+  bool exited = false;
+  ~ThreadFrame() {
+    exited = true;
+    if (buffer) {
+      std::lock_guard<std::mutex> lk(FrameBuffersMutex);
+      buffer->orphaned = true;
+    }
+  }
+  /* Null once the thread is exiting, so late reports are delivered directly */
+  FrameBuffer* get() {
+    if (!buffer && !exited) {
+      buffer = new FrameBuffer;
+      std::lock_guard<std::mutex> lk(FrameBuffersMutex);
+      FrameBuffers.push_back(buffer);
+    }
+    return exited ? nullptr : buffer;
+  }
+};
+static thread_local ThreadFrame CurrentFrame;
+
+static size_t AppendFrameText(std::vector<char>& text, const char* data, size_t len) {
+  size_t offset = text.size();
+  text.insert(text.end(), data, data + len);
+  return offset;
+}
+
+/* Caller must hold the log lock */
+static void ReportBatchedRecord(ILogger& logger, const LogRecord& record, const char* format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  if (record.fieldCount)
+    logger.reportFields(record.modName, record.severity, record.file, record.linenum, record.fields,
+                        record.fieldCount, format, ap);
+  else if (record.file)
+    logger.reportSource(record.modName, record.severity, record.file, record.linenum, format, ap);
+  else
+    logger.report(record.modName, record.severity, format, ap);
+  va_end(ap);
+}
+
+static void FlushFrames() {
+  if (!FramePending.load(std::memory_order_relaxed) || !FramePending.exchange(false, std::memory_order_acquire))
+    return;
+  std::vector<FrameContents> frames;
+  {
+    std::lock_guard<std::mutex> lk(FrameBuffersMutex);
+    for (auto it = FrameBuffers.begin(); it != FrameBuffers.end();) {
+      FrameBuffer* buffer = *it;
+      {
+        std::lock_guard<std::mutex> blk(buffer->mutex);
+        if (!buffer->contents.entries.empty())
+          frames.push_back(std::exchange(buffer->contents, FrameContents()));
+      }
+      if (buffer->orphaned) {
+        delete buffer;
+        it = FrameBuffers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::vector<std::pair<FrameContents*, const FrameEntry*>> order;
+  for (FrameContents& frame : frames) {
+    for (LogField& field : frame.fields) {
+      field.key = frame.text.data() + uintptr_t(field.key);
+      if (field.type == LogField::String)
+        field.str.data = frame.text.data() + uintptr_t(field.str.data);
+    }
+    for (const FrameEntry& entry : frame.entries)
+      order.emplace_back(&frame, &entry);
+  }
+  /* Batched reports are counted as they are delivered, under the log lock */
+  _LogCounter.fetch_add(order.size(), std::memory_order_relaxed);
+  std::stable_sort(order.begin(), order.end(),
+                   [](const auto& a, const auto& b) { return a.second->head.uptimeNs < b.second->head.uptimeNs; });
+
+  std::vector<LogRecord> records(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    const FrameContents& frame = *order[i].first;
+    const FrameEntry& entry = *order[i].second;
+    LogRecord& record = records[i];
+    record.modName = entry.modName;
+    record.severity = entry.severity;
+    record.file = entry.file;
+    record.linenum = entry.linenum;
+    record.sourceInfo = entry.sourceInfo == SIZE_MAX ? nullptr : frame.text.data() + entry.sourceInfo;
+    record.uptimeNs = entry.head.uptimeNs;
+    record.wallNs = entry.head.wallNs;
+    record.frameIndex = entry.head.frameIndex;
+    record.thread = entry.head.thread;
+    record.message = std::string_view(frame.text.data() + entry.message, entry.messageLen);
+    record.fields = entry.fieldCount ? frame.fields.data() + entry.fields : nullptr;
+    record.fieldCount = entry.fieldCount;
+  }
+  for (ILogger* logger : MainLoggers.snapshot()) {
+    CountRecords(*logger, records.size());
+    if (LogSink* sink = logger->asSink()) {
+      sink->writeBatch(records.data(), records.size());
+      continue;
+    }
+    /* Loggers that aren't sinks get each record as rendered text, stamped with its original head */
+    const RecordHead* prevHead = ReplayHead;
+    for (const LogRecord& record : records) {
+      RecordHead head = HeadOf(record);
+      ReplayHead = &head;
+      ReportBatchedRecord(*logger, record, "%.*s", int(record.message.size()), record.message.data());
+    }
+    ReplayHead = prevHead;
+  }
+}
+
+/* Renders a report into the calling thread's frame buffer; returns false to deliver it directly */
+template <typename CharType>
+static bool BatchReport(const char* modName, Level severity, const char* file, unsigned linenum,
+                        const LogField* fields, size_t fieldCount, const CharType* format, va_list ap) {
+  FrameBuffer* buffer = CurrentFrame.get();
+  if (!buffer)
+    return false;
+  uint64_t start = CurrentUptimeNs();
+  detail::FormatBuffer nested;
+  detail::FormatBuffer& msg = SinkDepth ? nested : SinkMessageBuffer;
+  LogRecord record;
+  char sourceInfo[128];
+  BuildRecord(record, msg, sourceInfo, CaptureHead(), modName, severity, file, linenum, fields, fieldCount, format,
+              ap);
+  if (FlightEnabled(severity))
+    RecordFlightText(modName, severity, record.message);
+
+  size_t textSize;
+  {
+    std::lock_guard<std::mutex> lk(buffer->mutex);
+    FrameContents& frame = buffer->contents;
+    FrameEntry entry{HeadOf(record), modName, file, linenum, severity, 0, record.message.size(), SIZE_MAX,
+                     frame.fields.size(), fieldCount};
+    entry.message = AppendFrameText(frame.text, record.message.data(), record.message.size());
+    if (record.sourceInfo)
+      entry.sourceInfo = AppendFrameText(frame.text, sourceInfo, strlen(sourceInfo) + 1);
+    for (size_t i = 0; i < fieldCount; ++i) {
+      LogField field = fields[i];
+      field.key = (const char*)uintptr_t(AppendFrameText(frame.text, field.key, strlen(field.key) + 1));
+      if (field.type == LogField::String)
+        field.str.data = (const char*)uintptr_t(AppendFrameText(frame.text, field.str.data, field.str.size));
+      frame.fields.push_back(field);
+    }
+    frame.entries.push_back(entry);
+    textSize = frame.text.size();
+  }
+  if (!FramePending.load(std::memory_order_relaxed))
+    FramePending.store(true, std::memory_order_release);
+
+  if (textSize >= FrameBatchLimit.load(std::memory_order_relaxed)) {
+    auto lk = LockLog();
+    CountLockWait(start, CurrentUptimeNs());
+    FlushFrames();
+  }
+  CountReport(modName, severity, start, CurrentUptimeNs());
+  return true;
+}
+
+void EnableFrameBatching(size_t maxBytesPerThread) {
+  FrameBatchLimit.store(maxBytesPerThread, std::memory_order_relaxed);
+  FrameBatching.store(true);
+}
+
+void DisableFrameBatching() {
+  FrameBatching.store(false);
+  auto lk = LockLog();
+  FlushFrames();
+}
+
+void EndFrame() {
+  auto lk = LockLog();
+  FlushFrames();
+}
+
+template <typename CharType>
+static void ReportSync(const char* modName, Level severity, const char* file, unsigned linenum,
+                       const LogField* fields, size_t fieldCount, const CharType* format, va_list ap) {
+  NoteDeliveredReport();
+  if (severity < Error && FrameBatching.load(std::memory_order_relaxed) && !InAsyncWriter &&
+      BatchReport(modName, severity, file, linenum, fields, fieldCount, format, ap))
+    return;
+  uint64_t start = CurrentUptimeNs();
+  auto lk = LockLog();
+  CountLockWait(start, CurrentUptimeNs());
+  /* Anything held for the current frame goes out ahead of this report */
+  FlushFrames();
+  if (severity == Fatal) {
+    FlushLog();
+    RegisterConsoleLogger();
+  } else if (_AsyncLogging.load() && !InAsyncWriter) {
+    /* Structured and oversized reports skip the queue; everything claimed before this point goes
+     * first to keep order, including cells other producers are still filling in */
+    AsyncQueue& queue = *AsyncLogQueue;
+    size_t end = queue.enqueuePos.load();
+    while (queue.dequeuePos.load() < end)
+      if (!DrainAsyncQueue(queue, SIZE_MAX))
+        std::this_thread::yield();
+  }
+  _LogCounter.fetch_add(1, std::memory_order_relaxed);
+  DeliverReport(modName, severity, file, linenum, fields, fieldCount, format, ap);
+  CountReport(modName, severity, start, CurrentUptimeNs());
+  if (severity == Error || severity == Fatal)
+    logvisorBp();
+  if (severity == Fatal)
+    logvisorAbort();
+  else if (severity == Error)
+    ++ErrorCount;
+}
+
+void _ReportFields(const char* modName, Level severity, const char* file, unsigned linenum, const LogField* fields,
+                   size_t fieldCount, const char* format, va_list ap) {
+  ReportSync(modName, severity, file, linenum, fields, fieldCount, format, ap);
+}
+
+/* Periodic LogStats summaries */
+static std::thread StatsDumper;
+static std::mutex StatsDumpMutex;
+static std::condition_variable StatsDumpCond;
+static bool StatsDumpRunning = false;
+
+static void StatsDumpProc(unsigned intervalMs, Level severity) {
+  RegisterThreadName("logvisor stats");
+  std::unique_lock<std::mutex> lk(StatsDumpMutex);
+  while (StatsDumpRunning) {
+    if (StatsDumpCond.wait_for(lk, std::chrono::milliseconds(intervalMs), [] { return !StatsDumpRunning; }))
+      break;
+    lk.unlock();
+    LogStats stats = GetLogStats();
+    std::string top;
+    for (size_t i = 0; i < stats.modules.size() && i < 5; ++i) {
+      const LogStats::ModuleStats& mod = stats.modules[i];
+      char entry[64];
+      snprintf(entry, sizeof(entry), "=%" PRIu64 " ",
+               mod.reports[Info] + mod.reports[Warning] + mod.reports[Error] + mod.reports[Fatal]);
+      top += mod.name;
+      top += entry;
+    }
+    if (!top.empty())
+      top.pop_back();
+    Log.reportFields(severity,
+                     {{"reports", stats.reports},
+                      {"errors", stats.errors},
+                      {"suppressed", stats.suppressed},
+                      {"async_dropped", stats.asyncDropped},
+                      {"lock_wait_us", stats.lockWaitNs / 1000},
+                      {"latency_p50_ns", LogStats::Percentile(stats.latency, 0.5)},
+                      {"latency_p99_ns", LogStats::Percentile(stats.latency, 0.99)}},
+                     "log stats, busiest modules: %s", top.c_str());
+    lk.lock();
+  }
+}
+
+void EnableLogStatsDump(unsigned intervalMs, Level severity) {
+  DisableLogStatsDump();
+  std::lock_guard<std::mutex> lk(StatsDumpMutex);
+  static bool registeredExit = false;
+  if (!registeredExit) {
+    atexit(DisableLogStatsDump);
+    registeredExit = true;
+  }
+  StatsDumpRunning = true;
+  StatsDumper = std::thread(StatsDumpProc, std::max(intervalMs, 1u), severity);
+}
+
+void DisableLogStatsDump() {
+  {
+    std::lock_guard<std::mutex> lk(StatsDumpMutex);
+    StatsDumpRunning = false;
+  }
+  StatsDumpCond.notify_one();
+  if (StatsDumper.joinable())
+    StatsDumper.join();
+}
+
+void FlushLog() {
+  FlushSiteSummaries();
+  auto lk = LockLog();
+  FlushFrames();
+  if (_AsyncLogging.load() && !InAsyncWriter)
+    DrainAsyncQueue(*AsyncLogQueue, SIZE_MAX);
+  for (ILogger* logger : MainLoggers.snapshot())
+    logger->flush();
+}
+
 } // namespace logvisor
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/* Segment layout shared by the mapped logger and logvisor-segcat.
+ *
+ * A segment is a preallocated file starting with a Header, followed by 8-byte
+ * aligned records. Each record begins with a 32-bit word holding the payload
+ * length; writers store the length when space is reserved and set CommitBit
+ * once the payload has been copied in. Zero-filled space past the last
+ * reservation reads as a zero word, which marks the end of the segment.
+ * Payloads are the UTF-8 text lines a file logger would have written. */
+
+namespace logvisor {
+namespace seglog {
+
+static constexpr char Magic[8] = {'L', 'V', 'S', 'E', 'G', 'L', 'O', 'G'};
+static constexpr uint32_t Version = 1;
+static constexpr uint32_t CommitBit = 0x80000000;
+static constexpr size_t Alignment = 8;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t index; /**< Sequence number of this segment, matching its file suffix */
+};
+static_assert(sizeof(Header) % Alignment == 0, "records must start aligned");
+
+/* Bytes occupied by a record with a payload of len bytes, including its length word */
+inline constexpr size_t RecordSize(size_t len) { return (sizeof(uint32_t) + len + Alignment - 1) & ~(Alignment - 1); }
+
+inline void BeginRecord(uint8_t* rec, uint32_t len) {
+  std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(rec)).store(len, std::memory_order_relaxed);
+}
+
+inline void CommitRecord(uint8_t* rec, uint32_t len) {
+  std::atomic_ref<uint32_t>(*reinterpret_cast<uint32_t*>(rec)).store(len | CommitBit, std::memory_order_release);
+}
+
+enum class ReadResult { Record, Partial, End, Truncated };
+
+/* Reads the record at cur and advances past it. Partial records (reserved but
+ * never committed) are skipped; End is a zero word or the end of data. */
+inline ReadResult NextRecord(const uint8_t*& cur, const uint8_t* end, const char*& data, uint32_t& len) {
+  if (size_t(end - cur) < sizeof(uint32_t))
+    return ReadResult::End;
+  uint32_t word;
+  memcpy(&word, cur, sizeof(word));
+  if (!word)
+    return ReadResult::End;
+  len = word & ~CommitBit;
+  if (size_t(end - cur) < sizeof(uint32_t) + len)
+    return ReadResult::Truncated;
+  data = reinterpret_cast<const char*>(cur + sizeof(uint32_t));
+  cur += std::min(RecordSize(len), size_t(end - cur));
+  return (word & CommitBit) ? ReadResult::Record : ReadResult::Partial;
+}
+
+} // namespace seglog
+} // namespace logvisor
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/* Shared-memory ring shared by the ring logger and logvisor-collector.
+ *
+ * The producer creates a POSIX shared memory object holding a Header followed by
+ * capacity bytes of data, a power of two. Records are 8-byte aligned: a 32-bit
+ * payload length, a Record and then the module, thread name, file and message
+ * bytes. A record never wraps; PadMarker in place of a length sends the reader
+ * back to the start of the data. Sinks run under the log lock, so there is a single
+ * producer; it publishes records by advancing write, and the collector releases
+ * space by advancing read. Nothing else is shared, so neither side can block the
+ * other, and a producer crash loses nothing it had published. */
+
+namespace logvisor {
+namespace shmring {
+
+static constexpr char Magic[8] = {'L', 'V', 'S', 'H', 'R', 'I', 'N', 'G'};
+static constexpr uint32_t Version = 1;
+static constexpr uint32_t PadMarker = 0xffffffff;
+static constexpr size_t Alignment = 8;
+
+enum State : uint32_t {
+  Initializing, /**< Header not yet filled in */
+  Open,         /**< Producer is writing */
+  Closed        /**< Producer shut down; nothing more will be written */
+};
+
+struct Header {
+  char magic[8];
+  std::atomic<uint32_t> state;
+  uint32_t version;
+  uint64_t capacity;             /**< Data bytes following the header */
+  uint64_t producerPid;
+  uint64_t producerStart;        /**< ProcessStartTime() of the producer, or 0 if unknown */
+  std::atomic<uint64_t> dropped; /**< Records discarded because the ring was full */
+  alignas(64) std::atomic<uint64_t> write; /**< Bytes published; written only by the producer */
+  alignas(64) std::atomic<uint64_t> read;  /**< Bytes consumed; written only by the collector */
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring cursors must be address-free atomics");
+static_assert(sizeof(Header) % 64 == 0, "data must start cache-line aligned");
+
+struct Record {
+  uint64_t uptimeNs;
+  int64_t wallNs;
+  uint64_t frameIndex;
+  uint64_t threadId;
+  uint32_t linenum;
+  uint32_t messageLen;
+  uint16_t moduleLen;
+  uint16_t threadNameLen;
+  uint16_t fileLen;
+  uint8_t severity;
+  uint8_t reserved;
+};
+static_assert(sizeof(Record) % Alignment == 0, "strings follow the record directly");
+
+/* Bytes occupied by a record with a payload of len bytes, including its length word */
+inline constexpr size_t RecordSize(size_t len) { return (sizeof(uint32_t) + len + Alignment - 1) & ~(Alignment - 1); }
+
+inline uint8_t* Data(Header* header) { return reinterpret_cast<uint8_t*>(header + 1); }
+
+/* Start time of a process in clock ticks since boot, telling a reused PID apart from the
+ * producer; 0 where it can't be read */
+inline uint64_t ProcessStartTime(uint64_t pid) {
+#if __linux__
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%llu/stat", (unsigned long long)pid);
+  FILE* f = fopen(path, "r");
+  if (!f)
+    return 0;
+  char buf[1024];
+  size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+  /* The command name may contain spaces; fields resume after its closing parenthesis */
+  const char* p = strrchr(buf, ')');
+  if (!p)
+    return 0;
+  for (int field = 2; field < 22 && p; ++field)
+    p = strchr(p + 1, ' ');
+  return p ? strtoull(p + 1, nullptr, 10) : 0;
+#else
+  return 0;
+#endif
+}
+
+} // namespace shmring
+} // namespace logvisor
@@ -0,0 +1,108 @@
+/* logvisor-cat: prints file logger output written with FileCompression::LZ4
+ * as plain text. Files without the compressed preamble are copied through
+ * unchanged, so the tool works on any file logger output. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../lib/blockz.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+bool ReadFile(FILE* in, std::vector<uint8_t>& data) {
+  uint8_t chunk[65536];
+  size_t readSz;
+  while ((readSz = fread(chunk, 1, sizeof(chunk), in)))
+    data.insert(data.end(), chunk, chunk + readSz);
+  return !ferror(in);
+}
+
+bool HasMagic(const uint8_t* cur, const uint8_t* end) {
+  return size_t(end - cur) >= sizeof(blockz::Magic) + 1 && !memcmp(cur, blockz::Magic, sizeof(blockz::Magic));
+}
+
+bool CatFile(const char* path, const std::vector<uint8_t>& data, FILE* out) {
+  const uint8_t* cur = data.data();
+  const uint8_t* end = data.data() + data.size();
+  if (!HasMagic(cur, end)) {
+    fwrite(cur, 1, data.size(), out);
+    return true;
+  }
+
+  std::vector<uint8_t> raw;
+  while (cur < end) {
+    if (HasMagic(cur, end)) {
+      cur += sizeof(blockz::Magic);
+      if (*cur++ != blockz::Version) {
+        fprintf(stderr, "%s: unsupported block format version %u\n", path, unsigned(cur[-1]));
+        return false;
+      }
+      continue;
+    }
+    size_t offset = size_t(cur - data.data());
+    if (size_t(end - cur) < blockz::FrameHeaderSize) {
+      fprintf(stderr, "%s: truncated final block at offset %zu\n", path, offset);
+      return true;
+    }
+    uint32_t rawSize = blockz::GetLE32(cur);
+    uint32_t stored = blockz::GetLE32(cur + 4);
+    size_t storedSize = stored & ~blockz::StoredRaw;
+    cur += blockz::FrameHeaderSize;
+    if (size_t(end - cur) < storedSize) {
+      fprintf(stderr, "%s: truncated final block at offset %zu\n", path, offset);
+      return true;
+    }
+    if (rawSize > blockz::MaxBlockSize) {
+      fprintf(stderr, "%s: corrupt block at offset %zu\n", path, offset);
+      return false;
+    }
+    if (stored & blockz::StoredRaw) {
+      if (storedSize != rawSize) {
+        fprintf(stderr, "%s: corrupt block at offset %zu\n", path, offset);
+        return false;
+      }
+      fwrite(cur, 1, storedSize, out);
+    } else {
+      raw.resize(rawSize);
+      if (blockz::Decompress(cur, storedSize, raw.data(), raw.size()) != rawSize) {
+        fprintf(stderr, "%s: corrupt block at offset %zu\n", path, offset);
+        return false;
+      }
+      fwrite(raw.data(), 1, raw.size(), out);
+    }
+    cur += storedSize;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <log-file>... (- reads stdin)\n", argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  for (int i = 1; i < argc; ++i) {
+    bool isStdin = !strcmp(argv[i], "-");
+    FILE* in = isStdin ? stdin : fopen(argv[i], "rb");
+    if (!in) {
+      fprintf(stderr, "unable to open %s\n", argv[i]);
+      ok = false;
+      continue;
+    }
+    std::vector<uint8_t> data;
+    bool readOk = ReadFile(in, data);
+    if (!isStdin)
+      fclose(in);
+    if (!readOk) {
+      fprintf(stderr, "error reading %s\n", argv[i]);
+      ok = false;
+      continue;
+    }
+    ok &= CatFile(argv[i], data, stdout);
+  }
+  return ok ? 0 : 1;
+}
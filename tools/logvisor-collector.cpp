@@ -0,0 +1,232 @@
+/* logvisor-collector: maps a ring created by RegisterRingLogger() and writes its
+ * records as the text a file logger would have produced. Runs until the producer
+ * closes the ring or exits; a producer that crashed is detected by its PID, and
+ * every record it published before dying is still written out. */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../lib/shmring.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+struct Collector {
+  shmring::Header* header = nullptr;
+  size_t mapSize = 0;
+  ino_t inode = 0;
+  uint64_t reportedDropped = 0;
+  int wallStyle = 0; /**< 0 prints uptime, 'l' local time, 'u' UTC */
+
+  /* Maps the ring once its producer has filled in the header */
+  bool open(const char* name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) <= sizeof(shmring::Header)) {
+      ::close(fd);
+      return false;
+    }
+    void* base = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+      return false;
+    auto* h = (shmring::Header*)base;
+    if (h->state.load(std::memory_order_acquire) == shmring::Initializing ||
+        memcmp(h->magic, shmring::Magic, sizeof(shmring::Magic)) || h->version != shmring::Version ||
+        sizeof(shmring::Header) + h->capacity > size_t(st.st_size)) {
+      munmap(base, size_t(st.st_size));
+      return false;
+    }
+    header = h;
+    mapSize = size_t(st.st_size);
+    inode = st.st_ino;
+    return true;
+  }
+
+  bool producerAlive() const {
+    if (kill(pid_t(header->producerPid), 0) != 0 && errno == ESRCH)
+      return false;
+    return !header->producerStart || shmring::ProcessStartTime(header->producerPid) == header->producerStart;
+  }
+
+  /* Removes the name unless a newer producer has already replaced the ring */
+  void unlink(const char* name) const {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+      return;
+    struct stat st;
+    bool same = fstat(fd, &st) == 0 && st.st_ino == inode;
+    ::close(fd);
+    if (same)
+      shm_unlink(name);
+  }
+
+  static const char* severityName(uint8_t severity) {
+    switch (severity) {
+    case 0:
+      return "INFO";
+    case 1:
+      return "WARNING";
+    case 2:
+      return "ERROR";
+    case 3:
+      return "FATAL ERROR";
+    default:
+      return "";
+    }
+  }
+
+  void printWallTime(FILE* out, int64_t wallNs) {
+    int64_t second = wallNs / 1000000000;
+    int64_t subNs = wallNs % 1000000000;
+    if (subNs < 0) {
+      subNs += 1000000000;
+      --second;
+    }
+    time_t t = time_t(second);
+    struct tm tmv;
+    if (wallStyle == 'u')
+      gmtime_r(&t, &tmv);
+    else
+      localtime_r(&t, &tmv);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tmv);
+    fprintf(out, "[%s.%06u%s ", date, unsigned(subNs / 1000), wallStyle == 'u' ? "Z" : "");
+  }
+
+  void print(FILE* out, const shmring::Record& rec, const char* strings) {
+    if (wallStyle)
+      printWallTime(out, rec.wallNs);
+    else
+      fprintf(out, "[%5.4f ", rec.uptimeNs / 1000000000.0);
+    if (rec.frameIndex)
+      fprintf(out, "(%" PRIu64 ") ", rec.frameIndex);
+    fprintf(out, "%s %.*s", severityName(rec.severity), int(rec.moduleLen), strings);
+    strings += rec.moduleLen;
+    const char* threadName = strings;
+    strings += rec.threadNameLen;
+    if (rec.fileLen)
+      fprintf(out, " {%.*s:%u}", int(rec.fileLen), strings, unsigned(rec.linenum));
+    strings += rec.fileLen;
+    if (rec.threadNameLen)
+      fprintf(out, " (%.*s)", int(rec.threadNameLen), threadName);
+    fprintf(out, "] ");
+    fwrite(strings, 1, rec.messageLen, out);
+    fprintf(out, "\n");
+  }
+
+  /* Writes every published record and releases its space; returns the number written */
+  size_t drain(FILE* out) {
+    const uint8_t* data = shmring::Data(header);
+    uint64_t mask = header->capacity - 1;
+    uint64_t read = header->read.load(std::memory_order_relaxed);
+    uint64_t write = header->write.load(std::memory_order_acquire);
+    size_t count = 0;
+    while (read < write) {
+      size_t offset = size_t(read & mask);
+      uint32_t len;
+      memcpy(&len, data + offset, sizeof(len));
+      if (len == shmring::PadMarker) {
+        read += header->capacity - offset;
+        continue;
+      }
+      shmring::Record rec;
+      size_t size = shmring::RecordSize(len);
+      if (len < sizeof(rec) || size > header->capacity - offset) {
+        fprintf(stderr, "corrupt record at ring offset %zu\n", offset);
+        read = write;
+        break;
+      }
+      memcpy(&rec, data + offset + sizeof(len), sizeof(rec));
+      if (sizeof(rec) + rec.moduleLen + rec.threadNameLen + rec.fileLen + size_t(rec.messageLen) > len) {
+        fprintf(stderr, "corrupt record at ring offset %zu\n", offset);
+      } else {
+        print(out, rec, (const char*)data + offset + sizeof(len) + sizeof(rec));
+        ++count;
+      }
+      read += size;
+    }
+    header->read.store(read, std::memory_order_release);
+
+    uint64_t dropped = header->dropped.load(std::memory_order_relaxed);
+    if (dropped != reportedDropped) {
+      fprintf(stderr, "producer dropped %" PRIu64 " records on a full ring\n", dropped - reportedDropped);
+      reportedDropped = dropped;
+    }
+    if (count)
+      fflush(out);
+    return count;
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int wallStyle = 0;
+  unsigned pollMs = 10;
+  for (; argc > 1 && argv[1][0] == '-' && argv[1][1] == '-'; --argc, ++argv) {
+    if (!strcmp(argv[1], "--local")) {
+      wallStyle = 'l';
+    } else if (!strcmp(argv[1], "--utc")) {
+      wallStyle = 'u';
+    } else if (!strcmp(argv[1], "--poll") && argc > 2) {
+      pollMs = unsigned(strtoul(argv[2], nullptr, 10));
+      --argc;
+      ++argv;
+    } else {
+      argc = 0;
+    }
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: logvisor-collector [--local|--utc] [--poll <ms>] <ring-name> [<text-out>]\n");
+    return 1;
+  }
+  const char* name = argv[1];
+  FILE* out = stdout;
+  if (argc > 2 && !(out = fopen(argv[2], "a"))) {
+    fprintf(stderr, "unable to open %s\n", argv[2]);
+    return 1;
+  }
+
+  Collector collector;
+  collector.wallStyle = wallStyle;
+  auto poll = std::chrono::milliseconds(std::max(pollMs, 1u));
+  /* The producer may not have started yet */
+  while (!collector.open(name))
+    std::this_thread::sleep_for(poll);
+
+  int ret = 0;
+  for (;;) {
+    if (collector.drain(out))
+      continue;
+    if (collector.header->state.load(std::memory_order_acquire) == shmring::Closed) {
+      collector.drain(out);
+      break;
+    }
+    if (!collector.producerAlive()) {
+      collector.drain(out);
+      fprintf(stderr, "producer %" PRIu64 " exited without closing the ring\n", collector.header->producerPid);
+      ret = 2;
+      break;
+    }
+    std::this_thread::sleep_for(poll);
+  }
+  collector.unlink(name);
+  if (out != stdout)
+    fclose(out);
+  return ret;
+}
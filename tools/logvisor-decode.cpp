@@ -0,0 +1,336 @@
+/* logvisor-decode: renders files written by RegisterBinaryLogger() as the
+ * same text a file logger would have produced. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../lib/binlog.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+struct Decoder {
+  const uint8_t* begin;
+  const uint8_t* cur;
+  const uint8_t* end;
+  std::unordered_map<uint64_t, std::string> strings;
+  std::string message;
+  std::string spec;
+  uint8_t version = binlog::Version;
+  int wallStyle = 0; /**< 0 prints uptime, 'l' local time, 'u' UTC */
+
+  bool varint(uint64_t& v) { return binlog::GetVarint(cur, end, v); }
+
+  bool bytes(size_t len, std::string& out) {
+    if (size_t(end - cur) < len)
+      return false;
+    out.assign((const char*)cur, len);
+    cur += len;
+    return true;
+  }
+
+  const char* lookup(uint64_t id) {
+    if (!id)
+      return nullptr;
+    auto search = strings.find(id);
+    return search != strings.end() ? search->second.c_str() : "<unknown>";
+  }
+
+  template <typename... Args>
+  void append(Args... args) {
+    int len = snprintf(nullptr, 0, spec.c_str(), args...);
+    if (len <= 0)
+      return;
+    size_t offset = message.size();
+    message.resize(offset + len + 1);
+    snprintf(&message[offset], len + 1, spec.c_str(), args...);
+    message.resize(offset + len);
+  }
+
+  template <typename T>
+  void appendStars(bool hasWidth, int width, bool hasPrecision, int precision, T value) {
+    if (hasWidth && hasPrecision)
+      append(width, precision, value);
+    else if (hasWidth)
+      append(width, value);
+    else if (hasPrecision)
+      append(precision, value);
+    else
+      append(value);
+  }
+
+  /* Copies the conversion without its length modifiers, then inserts lengthMod before the conversion */
+  void buildSpec(const binlog::Spec& s, const char* lengthMod) {
+    spec.clear();
+    const char* conv = s.end - 1;
+    for (const char* p = s.begin; p < conv; ++p)
+      if (!strchr("hljztL", *p))
+        spec += *p;
+    spec += lengthMod;
+    spec += *conv;
+  }
+
+  bool formatArgs(const char* format) {
+    message.clear();
+    const char* p = format;
+    const char* lit = format;
+    binlog::Spec s;
+    while (binlog::NextSpec(p, s)) {
+      message.append(lit, s.begin);
+      lit = s.end;
+      if (s.cls == binlog::ArgClass::None && !s.starWidth && !s.starPrecision) {
+        if (s.end - s.begin == 2 && s.begin[1] == '%')
+          message += '%';
+        continue;
+      }
+      uint64_t v;
+      int width = 0, precision = 0;
+      if (s.starWidth) {
+        if (!varint(v))
+          return false;
+        width = int(binlog::UnZigZag(v));
+      }
+      if (s.starPrecision) {
+        if (!varint(v))
+          return false;
+        precision = int(binlog::UnZigZag(v));
+      }
+      char conv = s.end[-1];
+      switch (s.cls) {
+      case binlog::ArgClass::Signed:
+        if (!varint(v))
+          return false;
+        buildSpec(s, "ll");
+        appendStars(s.starWidth, width, s.starPrecision, precision, (long long)binlog::UnZigZag(v));
+        break;
+      case binlog::ArgClass::Unsigned:
+        if (!varint(v))
+          return false;
+        if (conv == 'c') {
+          buildSpec(s, "");
+          appendStars(s.starWidth, width, s.starPrecision, precision, int(v));
+        } else {
+          buildSpec(s, "ll");
+          appendStars(s.starWidth, width, s.starPrecision, precision, (unsigned long long)v);
+        }
+        break;
+      case binlog::ArgClass::Double:
+      case binlog::ArgClass::LongDouble: {
+        double d;
+        if (size_t(end - cur) < sizeof(d))
+          return false;
+        memcpy(&d, cur, sizeof(d));
+        cur += sizeof(d);
+        if (s.cls == binlog::ArgClass::LongDouble) {
+          buildSpec(s, "L");
+          appendStars(s.starWidth, width, s.starPrecision, precision, (long double)d);
+        } else {
+          buildSpec(s, "");
+          appendStars(s.starWidth, width, s.starPrecision, precision, d);
+        }
+        break;
+      }
+      case binlog::ArgClass::Pointer:
+        if (!varint(v))
+          return false;
+        buildSpec(s, "");
+        appendStars(s.starWidth, width, s.starPrecision, precision, (void*)(uintptr_t)v);
+        break;
+      case binlog::ArgClass::String:
+      case binlog::ArgClass::WideString:
+      case binlog::ArgClass::WideChar: {
+        /* Wide arguments were transcoded to UTF-8 and print as narrow strings */
+        std::string str;
+        bool isNull = false;
+        if (s.cls != binlog::ArgClass::WideChar) {
+          if (!varint(v))
+            return false;
+          isNull = !v;
+          if (s.cls == binlog::ArgClass::String && v && !bytes(v - 1, str))
+            return false;
+        }
+        if (s.cls != binlog::ArgClass::String && !isNull) {
+          if (!varint(v) || !bytes(v, str))
+            return false;
+        }
+        buildSpec(s, "");
+        spec.back() = 's';
+        appendStars(s.starWidth, width, s.starPrecision, precision, isNull ? (const char*)nullptr : str.c_str());
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    message.append(lit, p);
+    return true;
+  }
+
+  static const char* severityName(uint8_t severity) {
+    switch (severity) {
+    case 0:
+      return "INFO";
+    case 1:
+      return "WARNING";
+    case 2:
+      return "ERROR";
+    case 3:
+      return "FATAL ERROR";
+    default:
+      return "";
+    }
+  }
+
+  void printWallTime(FILE* out, int64_t wallNs) {
+    int64_t second = wallNs / 1000000000;
+    int64_t subNs = wallNs % 1000000000;
+    if (subNs < 0) {
+      subNs += 1000000000;
+      --second;
+    }
+    time_t t = time_t(second);
+    struct tm tmv;
+#if _WIN32
+    if (wallStyle == 'u')
+      gmtime_s(&tmv, &t);
+    else
+      localtime_s(&tmv, &t);
+#else
+    if (wallStyle == 'u')
+      gmtime_r(&t, &tmv);
+    else
+      localtime_r(&t, &tmv);
+#endif
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tmv);
+    fprintf(out, "[%s.%06u%s ", date, unsigned(subNs / 1000), wallStyle == 'u' ? "Z" : "");
+  }
+
+  bool record(FILE* out, bool preformatted) {
+    size_t offset = size_t(cur - 1 - begin);
+    if (cur >= end)
+      return false;
+    uint8_t severity = *cur++;
+    uint64_t modId, formatId, uptimeNs, wallNs = 0, frameIndex, threadId, fileId, linenum;
+    if (!varint(modId) || !varint(formatId) || !varint(uptimeNs) || (version >= 2 && !varint(wallNs)) ||
+        !varint(frameIndex) || !varint(threadId) || !varint(fileId) || !varint(linenum))
+      return false;
+    if (preformatted) {
+      uint64_t len;
+      if (!varint(len) || !bytes(len, message))
+        return false;
+    } else if (!formatId || !strings.count(formatId)) {
+      /* Arguments can't be decoded without the format that wrote them */
+      fprintf(stderr, "corrupt entry at offset %zu\n", offset);
+      return false;
+    } else if (!formatArgs(lookup(formatId))) {
+      return false;
+    }
+
+    if (wallStyle && version >= 2)
+      printWallTime(out, binlog::UnZigZag(wallNs));
+    else
+      fprintf(out, "[%5.4f ", uptimeNs / 1000000000.0);
+    if (frameIndex)
+      fprintf(out, "(%" PRIu64 ") ", frameIndex);
+    fprintf(out, "%s %s", severityName(severity), lookup(modId));
+    if (const char* file = lookup(fileId)) {
+      char sourceInfo[128];
+      snprintf(sourceInfo, 128, "%s:%u", file, unsigned(linenum));
+      fprintf(out, " {%s}", sourceInfo);
+    }
+    if (const char* thrName = lookup(threadId))
+      fprintf(out, " (%s)", thrName);
+    fprintf(out, "] ");
+    fwrite(message.data(), 1, message.size(), out);
+    fprintf(out, "\n");
+    return true;
+  }
+
+  bool run(FILE* out) {
+    while (cur < end) {
+      if (size_t(end - cur) >= sizeof(binlog::Magic) + 1 && !memcmp(cur, binlog::Magic, sizeof(binlog::Magic))) {
+        cur += sizeof(binlog::Magic);
+        version = *cur++;
+        if (version < binlog::MinVersion || version > binlog::Version) {
+          fprintf(stderr, "unsupported binary log version %u\n", unsigned(version));
+          return false;
+        }
+        strings.clear();
+        continue;
+      }
+      uint8_t tag = *cur++;
+      switch (tag) {
+      case binlog::TagFormat:
+      case binlog::TagModule:
+      case binlog::TagFile:
+      case binlog::TagThread: {
+        uint64_t id, len;
+        if (!varint(id) || !varint(len) || !bytes(len, strings[id]))
+          return false;
+        break;
+      }
+      case binlog::TagRecord:
+      case binlog::TagMessage:
+        if (!record(out, tag == binlog::TagMessage))
+          return false;
+        break;
+      default:
+        fprintf(stderr, "corrupt entry at offset %zu\n", size_t(cur - 1 - begin));
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int wallStyle = 0;
+  for (; argc > 1 && argv[1][0] == '-' && argv[1][1] == '-'; --argc, ++argv) {
+    if (!strcmp(argv[1], "--local"))
+      wallStyle = 'l';
+    else if (!strcmp(argv[1], "--utc"))
+      wallStyle = 'u';
+    else
+      argc = 0;
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: logvisor-decode [--local|--utc] <binary-log> [<text-out>]\n");
+    return 1;
+  }
+  FILE* in = fopen(argv[1], "rb");
+  if (!in) {
+    fprintf(stderr, "unable to open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[65536];
+  size_t readSz;
+  while ((readSz = fread(chunk, 1, sizeof(chunk), in)))
+    data.insert(data.end(), chunk, chunk + readSz);
+  fclose(in);
+
+  FILE* out = stdout;
+  if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+    fprintf(stderr, "unable to open %s\n", argv[2]);
+    return 1;
+  }
+
+  Decoder decoder;
+  decoder.wallStyle = wallStyle;
+  decoder.begin = decoder.cur = data.data();
+  decoder.end = data.data() + data.size();
+  bool ok = decoder.run(out);
+  if (!ok && decoder.cur >= decoder.end)
+    fprintf(stderr, "truncated final record\n");
+  if (out != stdout)
+    fclose(out);
+  return ok ? 0 : 1;
+}
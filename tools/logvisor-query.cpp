@@ -0,0 +1,420 @@
+/* logvisor-query: finds records in a text or JSON file logger output by uptime,
+ * frame, severity, module and substring. With the "<log>.idx" sidecar written when
+ * FileLoggerOptions::indexInterval is set, only runs of records whose summaries can
+ * match are read; without one the whole file is scanned. Uptime bounds are exact
+ * when the log carries uptime timestamps and per run when it carries wall time. */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "../lib/logindex.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+struct MappedFile {
+  const char* data = nullptr;
+  size_t size = 0;
+
+  bool map(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    size = size_t(st.st_size);
+    void* base = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+    close(fd);
+    if (base == MAP_FAILED)
+      return false;
+    data = (const char*)base;
+    return true;
+  }
+
+  ~MappedFile() {
+    if (data)
+      munmap((void*)data, size);
+  }
+};
+
+size_t FindScalar(const char* hay, size_t n, std::string_view needle) {
+  std::string_view::size_type pos = std::string_view(hay, n).find(needle);
+  return pos == std::string_view::npos ? n : pos;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Substring search comparing the first and last needle bytes at 16 or 32 positions at
+ * once; only positions where both match are compared in full */
+__attribute__((target("sse2"))) size_t FindSse2(const char* hay, size_t n, std::string_view needle) {
+  size_t m = needle.size();
+  const __m128i first = _mm_set1_epi8(needle.front());
+  const __m128i last = _mm_set1_epi8(needle.back());
+  size_t i = 0;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(hay + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(hay + i + m - 1));
+    unsigned mask = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+    for (; mask; mask &= mask - 1) {
+      size_t pos = i + size_t(__builtin_ctz(mask));
+      if (!memcmp(hay + pos + 1, needle.data() + 1, m - 2))
+        return pos;
+    }
+  }
+  size_t tail = FindScalar(hay + i, n - i, needle);
+  return i + tail;
+}
+
+__attribute__((target("avx2"))) size_t FindAvx2(const char* hay, size_t n, std::string_view needle) {
+  size_t m = needle.size();
+  const __m256i first = _mm256_set1_epi8(needle.front());
+  const __m256i last = _mm256_set1_epi8(needle.back());
+  size_t i = 0;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(hay + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(hay + i + m - 1));
+    unsigned mask =
+        unsigned(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+    for (; mask; mask &= mask - 1) {
+      size_t pos = i + size_t(__builtin_ctz(mask));
+      if (!memcmp(hay + pos + 1, needle.data() + 1, m - 2))
+        return pos;
+    }
+  }
+  size_t tail = FindScalar(hay + i, n - i, needle);
+  return i + tail;
+}
+#endif
+
+/* Offset of the first occurrence of needle in hay, or n if there is none */
+size_t Find(const char* hay, size_t n, std::string_view needle) {
+  if (needle.size() < 2) {
+    if (needle.empty())
+      return 0;
+    const void* hit = memchr(hay, needle[0], n);
+    return hit ? size_t((const char*)hit - hay) : n;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 ? FindAvx2(hay, n, needle) : FindSse2(hay, n, needle);
+#else
+  return FindScalar(hay, n, needle);
+#endif
+}
+
+struct Head {
+  bool hasUptime = false;
+  uint64_t uptimeNs = 0;
+  uint64_t frame = 0;
+  int severity = 0;
+  std::string_view module;
+};
+
+bool ParseDecimal(const char*& p, const char* end, uint64_t& value) {
+  const char* begin = p;
+  for (value = 0; p < end && *p >= '0' && *p <= '9'; ++p)
+    value = value * 10 + uint64_t(*p - '0');
+  return p != begin;
+}
+
+bool ParseSeverity(std::string_view name, int& severity) {
+  static const char* const Names[] = {"INFO", "WARNING", "ERROR", "FATAL ERROR"};
+  for (int i = 0; i < 4; ++i) {
+    if (name == Names[i]) {
+      severity = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* "[uptime (frame) SEVERITY module {file:line} (thread)] ", where uptime may instead be a wall time */
+bool ParseTextHead(const char* p, const char* end, Head& head) {
+  if (p == end || *p++ != '[')
+    return false;
+  if (end - p > 11 && p[4] == '-' && p[7] == '-' && p[10] == ' ') {
+    const char* time = (const char*)memchr(p + 11, ' ', size_t(end - p - 11));
+    if (!time)
+      return false;
+    p = time + 1;
+  } else {
+    uint64_t seconds, ticks;
+    if (!ParseDecimal(p, end, seconds) || p == end || *p++ != '.')
+      return false;
+    const char* frac = p;
+    if (!ParseDecimal(p, end, ticks) || p - frac != 4 || p == end || *p++ != ' ')
+      return false;
+    head.hasUptime = true;
+    head.uptimeNs = seconds * 1000000000 + ticks * 100000;
+  }
+  if (p < end && *p == '(') {
+    ++p;
+    if (!ParseDecimal(p, end, head.frame) || end - p < 2 || p[0] != ')' || p[1] != ' ')
+      return false;
+    p += 2;
+  }
+  std::string_view rest(p, size_t(end - p));
+  size_t sevEnd = rest.starts_with("FATAL ERROR ") ? 11 : rest.find(' ');
+  if (sevEnd == std::string_view::npos || !ParseSeverity(rest.substr(0, sevEnd), head.severity))
+    return false;
+  p += sevEnd + 1;
+  for (const char* mod = p; p < end; ++p) {
+    if ((*p == ' ' && p + 1 < end && (p[1] == '{' || p[1] == '(')) || (*p == ']' && p + 1 < end && p[1] == ' ')) {
+      head.module = std::string_view(mod, size_t(p - mod));
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* FindKey(const char* p, const char* end, std::string_view key) {
+  size_t pos = Find(p, size_t(end - p), key);
+  return pos < size_t(end - p) ? p + pos + key.size() : nullptr;
+}
+
+std::string_view JsonString(const char* p, const char* end) {
+  const char* close = p ? (const char*)memchr(p, '"', size_t(end - p)) : nullptr;
+  return close ? std::string_view(p, size_t(close - p)) : std::string_view();
+}
+
+/* One object per line as written by RegisterJsonLogger() */
+bool ParseJsonHead(const char* p, const char* end, Head& head) {
+  static constexpr std::string_view Uptime = "{\"uptime_ns\":";
+  if (size_t(end - p) < Uptime.size() || memcmp(p, Uptime.data(), Uptime.size()))
+    return false;
+  p += Uptime.size();
+  if (!ParseDecimal(p, end, head.uptimeNs))
+    return false;
+  head.hasUptime = true;
+  if (const char* frame = FindKey(p, end, "\"frame\":"))
+    ParseDecimal(frame, end, head.frame);
+  head.module = JsonString(FindKey(p, end, "\"module\":\""), end);
+  return ParseSeverity(JsonString(FindKey(p, end, "\"severity\":\""), end), head.severity);
+}
+
+bool ParseHead(const char* line, const char* end, Head& head) {
+  head = Head();
+  return ParseTextHead(line, end, head) || ParseJsonHead(line, end, head);
+}
+
+const char* LineEnd(const char* p, const char* end) {
+  const char* nl = (const char*)memchr(p, '\n', size_t(end - p));
+  return nl ? nl + 1 : end;
+}
+
+struct Query {
+  uint64_t minUptimeNs = 0, maxUptimeNs = UINT64_MAX;
+  uint64_t minFrame = 0, maxFrame = UINT64_MAX;
+  int minSeverity = 0;
+  std::string module;
+  std::string text;
+  bool count = false;
+  bool verbose = false;
+
+  /* Text headers round uptime to 0.1 ms, so runs within half of that of the bounds may hold matches */
+  static constexpr uint64_t UptimeSlackNs = 50000;
+
+  bool matches(const logindex::Entry& entry) const {
+    return entry.maxUptimeNs + UptimeSlackNs >= minUptimeNs &&
+           entry.minUptimeNs <= std::max(maxUptimeNs, maxUptimeNs + UptimeSlackNs) && entry.maxFrame >= minFrame &&
+           entry.minFrame <= maxFrame && (entry.severities >> minSeverity) &&
+           (module.empty() || (entry.modules & logindex::ModuleBit(module.data(), module.size())));
+  }
+
+  bool matches(const Head& head) const {
+    return (!head.hasUptime || (head.uptimeNs >= minUptimeNs && head.uptimeNs <= maxUptimeNs)) &&
+           head.frame >= minFrame && head.frame <= maxFrame && head.severity >= minSeverity &&
+           (module.empty() || head.module == module);
+  }
+};
+
+struct Scanner {
+  const Query& query;
+  FILE* out;
+  uint64_t matched = 0;
+  uint64_t scanned = 0;
+
+  /* Record starting at line: its head and where the next one starts */
+  const char* recordEnd(const char* line, const char* end) {
+    Head next;
+    const char* p = LineEnd(line, end);
+    while (p < end && !ParseHead(p, LineEnd(p, end), next))
+      p = LineEnd(p, end);
+    return p;
+  }
+
+  void emit(const char* begin, const char* end) {
+    ++matched;
+    if (!query.count)
+      fwrite(begin, 1, size_t(end - begin), out);
+  }
+
+  void scan(const char* begin, const char* end) {
+    scanned += uint64_t(end - begin);
+    Head head;
+    const char* p = begin;
+    if (query.text.empty()) {
+      while (p < end) {
+        const char* next = recordEnd(p, end);
+        if (ParseHead(p, LineEnd(p, end), head) && query.matches(head))
+          emit(p, next);
+        p = next;
+      }
+      return;
+    }
+    /* Find the text first, then check the record around each hit */
+    while (p < end) {
+      size_t pos = Find(p, size_t(end - p), query.text);
+      if (pos == size_t(end - p))
+        return;
+      const char* hit = p + pos;
+      const char* start = hit;
+      for (;;) {
+        while (start > p && start[-1] != '\n')
+          --start;
+        if (start == p || ParseHead(start, LineEnd(start, end), head))
+          break;
+        --start;
+      }
+      const char* next = recordEnd(start, end);
+      if (ParseHead(start, LineEnd(start, end), head) && query.matches(head))
+        emit(start, next);
+      p = next;
+    }
+  }
+};
+
+bool ParseRange(const char* arg, uint64_t& low, uint64_t& high, double scale) {
+  const char* colon = strchr(arg, ':');
+  if (!colon)
+    return false;
+  if (colon != arg)
+    low = uint64_t(strtod(arg, nullptr) * scale);
+  if (colon[1])
+    high = uint64_t(strtod(colon + 1, nullptr) * scale);
+  return true;
+}
+
+int Usage() {
+  fprintf(stderr, "usage: logvisor-query [options] <log-file>\n"
+                  "  --uptime A:B    uptime between A and B seconds; either bound may be left out\n"
+                  "  --frames A:B    FrameIndex between A and B\n"
+                  "  --severity L    level L or above: info, warning, error or fatal\n"
+                  "  --module NAME   reported through module NAME\n"
+                  "  --grep TEXT     containing TEXT\n"
+                  "  --count         print the number of matching records instead of the records\n"
+                  "  --verbose       report how much of the log was read\n");
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Query query;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] == '-'; ++arg) {
+    std::string_view opt = argv[arg];
+    const char* value = arg + 1 < argc ? argv[arg + 1] : nullptr;
+    if (opt == "--count") {
+      query.count = true;
+    } else if (opt == "--verbose") {
+      query.verbose = true;
+    } else if (!value) {
+      return Usage();
+    } else if (opt == "--uptime") {
+      if (!ParseRange(argv[++arg], query.minUptimeNs, query.maxUptimeNs, 1e9))
+        return Usage();
+    } else if (opt == "--frames") {
+      if (!ParseRange(argv[++arg], query.minFrame, query.maxFrame, 1.0))
+        return Usage();
+    } else if (opt == "--severity") {
+      static const char* const Levels[] = {"info", "warning", "error", "fatal"};
+      query.minSeverity = -1;
+      for (int i = 0; i < 4; ++i)
+        if (!strcmp(argv[arg + 1], Levels[i]))
+          query.minSeverity = i;
+      if (query.minSeverity < 0)
+        return Usage();
+      ++arg;
+    } else if (opt == "--module") {
+      query.module = argv[++arg];
+    } else if (opt == "--grep") {
+      query.text = argv[++arg];
+    } else {
+      return Usage();
+    }
+  }
+  if (arg + 1 != argc)
+    return Usage();
+
+  const char* path = argv[arg];
+  MappedFile log;
+  if (!log.map(path)) {
+    fprintf(stderr, "unable to open %s\n", path);
+    return 1;
+  }
+  MappedFile index;
+  std::string indexPath = std::string(path) + ".idx";
+  const logindex::Entry* entries = nullptr;
+  size_t entryCount = 0, entrySize = sizeof(logindex::Entry);
+  if (index.map(indexPath.c_str()) && index.size >= sizeof(logindex::Header)) {
+    logindex::Header header;
+    memcpy(&header, index.data, sizeof(header));
+    if (memcmp(header.magic, logindex::Magic, sizeof(header.magic)) || header.version != logindex::Version ||
+        header.entrySize < sizeof(logindex::Entry)) {
+      fprintf(stderr, "%s: unsupported index, scanning the whole log\n", indexPath.c_str());
+    } else {
+      entries = (const logindex::Entry*)(index.data + sizeof(header));
+      entrySize = header.entrySize;
+      entryCount = (index.size - sizeof(header)) / entrySize;
+    }
+  }
+
+  /* Runs whose summaries can match, plus any bytes no entry covers */
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  auto addRange = [&](uint64_t begin, uint64_t end) {
+    end = std::min<uint64_t>(end, log.size);
+    if (begin >= end)
+      return;
+    if (!ranges.empty() && ranges.back().second == begin)
+      ranges.back().second = end;
+    else
+      ranges.emplace_back(begin, end);
+  };
+  uint64_t covered = 0;
+  for (size_t i = 0; i < entryCount; ++i) {
+    logindex::Entry entry;
+    memcpy(&entry, (const char*)entries + i * entrySize, sizeof(entry));
+    if (entry.offset > covered)
+      addRange(covered, entry.offset);
+    if (query.matches(entry))
+      addRange(entry.offset, entry.offset + entry.length);
+    covered = std::max(covered, entry.offset + entry.length);
+  }
+  addRange(covered, log.size);
+
+  Scanner scanner{query, stdout};
+  for (auto [begin, end] : ranges)
+    scanner.scan(log.data + begin, log.data + end);
+  if (query.count)
+    printf("%" PRIu64 "\n", scanner.matched);
+  if (query.verbose)
+    fprintf(stderr,
+            "%" PRIu64 " records matched; read %" PRIu64 " of %zu bytes in %zu ranges using %zu index entries\n",
+            scanner.matched, scanner.scanned, log.size, ranges.size(), entryCount);
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* logvisor-segcat: prints segments written by RegisterMappedLogger() as the
+ * text a file logger would have produced. Segments may come from a process
+ * that crashed mid-write; uncommitted and truncated records are skipped. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../lib/seglog.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+bool ReadFile(const char* path, std::vector<uint8_t>& data) {
+  FILE* in = fopen(path, "rb");
+  if (!in)
+    return false;
+  data.clear();
+  uint8_t chunk[65536];
+  size_t readSz;
+  while ((readSz = fread(chunk, 1, sizeof(chunk), in)))
+    data.insert(data.end(), chunk, chunk + readSz);
+  fclose(in);
+  return true;
+}
+
+bool CatSegment(const char* path, FILE* out) {
+  std::vector<uint8_t> data;
+  if (!ReadFile(path, data)) {
+    fprintf(stderr, "unable to open %s\n", path);
+    return false;
+  }
+  seglog::Header header;
+  if (data.size() < sizeof(header) || memcmp(data.data(), seglog::Magic, sizeof(seglog::Magic))) {
+    fprintf(stderr, "%s: not a log segment\n", path);
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.version != seglog::Version) {
+    fprintf(stderr, "%s: unsupported segment version %u\n", path, unsigned(header.version));
+    return false;
+  }
+
+  const uint8_t* cur = data.data() + sizeof(header);
+  const uint8_t* end = data.data() + data.size();
+  const char* text;
+  uint32_t len;
+  for (;;) {
+    switch (seglog::NextRecord(cur, end, text, len)) {
+    case seglog::ReadResult::Record:
+      fwrite(text, 1, len, out);
+      break;
+    case seglog::ReadResult::Partial:
+      fprintf(stderr, "%s: skipped uncommitted record at offset %zu\n", path,
+              size_t(text - sizeof(uint32_t) - (const char*)data.data()));
+      break;
+    case seglog::ReadResult::Truncated:
+      fprintf(stderr, "%s: truncated final record\n", path);
+      return true;
+    case seglog::ReadResult::End:
+      return true;
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <segment>...\n", argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  for (int i = 1; i < argc; ++i)
+    ok &= CatSegment(argv[i], stdout);
+  return ok ? 0 : 1;
+}